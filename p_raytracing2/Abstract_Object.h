@@ -1,27 +1,90 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <optional>
+#include <vector>
 #include "HDR_RGB.h"
+#include "Bounding_Box.h"
 #include "Ray.h"
+#include "Ray_Packet.h"
+#include "Intersection.h"
+#include "Hit_Record.h"
 
 namespace RT {
 
-	class Intersection;
-
 	class Abstract_Object {
 	public:
 		Abstract_Object() = delete;
-		Abstract_Object(const HDR_rgb& color, double shininess = 0.1) : color_(color), shininess_(shininess) {
+		Abstract_Object(const HDR_rgb& color, real shininess = 0.1) : color_(color), shininess_(shininess) {
 			assert(shininess_ > 0.0);
 		}
 
 		const HDR_rgb& color() const { return color_; }
-		double shininess() const { return shininess_; }
-		virtual std::optional<Intersection> intersect(const Ray& ray, double t_min, double t_max) const = 0;
+		real shininess() const { return shininess_; }
+		virtual std::optional<Intersection> intersect(const Ray& ray, real t_min, real t_max) const = 0;
+		virtual Bounding_Box bounding_box() const = 0;
+
+		// Closest hit search without building an Intersection. Overwrites the record and returns
+		// true for a hit within [t_min, record.t). The default goes through intersect(); the
+		// built in objects override it with a test that only finds t.
+		virtual bool find_hit(const Ray& ray, real t_min, Hit_Record& record) const {
+			std::optional<Intersection> hit = intersect(ray, t_min, record.t);
+			if (hit == std::nullopt || !(hit->t() < record.t))
+				return false;
+			record = Hit_Record(hit->t());
+			record.object = this;
+			return true;
+		}
+
+		// Builds the Intersection for a record filled in by this object's find_hit(). The default
+		// repeats intersect() in a window around record.t, widened to the rounding error of a hit
+		// point if the exact window misses (record.t may have been rescaled, as by Instance). Should
+		// that miss too, the hit point is kept with a normal facing the ray.
+		virtual Intersection make_intersection(const Ray& ray, const Hit_Record& record) const {
+			std::optional<Intersection> hit = intersect(ray, std::nextafter(record.t, REAL_NEGATIVE_INFINITY), std::nextafter(record.t, REAL_INFINITY));
+			if (hit != std::nullopt)
+				return *hit;
+			real window = std::max(std::abs(record.t), real(1)) * RELATIVE_RAY_EPSILON;
+			hit = intersect(ray, record.t - window, record.t + window);
+			if (hit != std::nullopt)
+				return *hit;
+			return Intersection(this, ray.point_along_ray(record.t), record.t, -ray.direction());
+		}
+
+		// Whether anything of the object lies on the ray within [t_min, t_max). Shadow rays only
+		// need this answer, so objects override it to stop at the first hit.
+		virtual bool occluded(const Ray& ray, real t_min, real t_max) const {
+			Hit_Record record(t_max);
+			return find_hit(ray, t_min, record);
+		}
+
+		// occluded() that also names the blocking primitive, for occluder caches; primitive is
+		// set only when true is returned. Objects made of one primitive report 0.
+		virtual bool find_occluder(const Ray& ray, real t_min, real t_max, uint32_t& primitive) const {
+			primitive = 0;
+			return occluded(ray, t_min, t_max);
+		}
+		// Whether that primitive alone lies on the ray within [t_min, t_max)
+		virtual bool occluded_by(const Ray& ray, real t_min, real t_max, uint32_t) const {
+			return occluded(ray, t_min, t_max);
+		}
+
+		// find_hit() for the rays of the active mask, records[i] belongs to packet.ray(i) and its t
+		// is kept equal to the ray's t_max. Objects that gain from tracing the rays together,
+		// like meshes, override this; the default traces them one by one.
+		virtual void find_hits(Ray_Packet& packet, real t_min, uint64_t active, Hit_Record* records) const {
+			for (; active != 0; active &= active - 1) {
+				size_t i = lowest_bit(active);
+				if (find_hit(packet.ray(i), t_min, records[i]))
+					packet.t_max(i, records[i].t);
+			}
+		}
+		virtual ~Abstract_Object() = default;
 		
 	private:
 		HDR_rgb color_;
-		double shininess_;
+		real shininess_;
 	};
 
 }
\ No newline at end of file
@@ -1,15 +1,57 @@
 #pragma once
+#include <cstddef>
+#include <vector>
+#include "HDR_RGB.h"
+#include "Intersection.h"
+#include "Ray.h"
 
 namespace RT {
 
 	class Camera;
+	class Light;
 	class Scene;
-	class HDR_rgb;
-	class Intersection;
+
+	// What one light adds to a shading point where it is visible, before the sum is clamped: a
+	// diffuse colour and a white specular highlight
+	struct Light_Term {
+		real diffuse[3];
+		real specular;
+	};
+
+	// A light a deferred shading point has to test, and what it adds there if visible
+	struct Deferred_Light {
+		const Light* light;
+		Light_Term term;
+	};
 
 	class Abstract_Shader {
 	public:
 		virtual HDR_rgb shade(const Scene& scene, const Camera& camera, const Intersection& intersection) const = 0;
+		// colors[i] = shade(intersections[i]) for a whole batch. Renderers pass the hits of one
+		// object next to each other, so shaders can read the material once per run of hits and
+		// work on several hits at a time; the colours do not depend on the grouping.
+		virtual void shade_batch(const Scene& scene, const Camera& camera, const Intersection* intersections, size_t count, HDR_rgb* colors) const {
+			for (size_t i = 0; i < count; ++i)
+				colors[i] = shade(scene, camera, intersections[i]);
+		}
+
+		// Deferred lighting, for renderers that trace the shadow rays of many points together.
+		// color gets the part of shade() that needs no shadow ray, like the ambient term, and every
+		// light to test is appended to lights. The shadow ray runs from the hit point to the light;
+		// adding the terms of the lights light_visible() reports, in order, with add_clamped()
+		// gives shade(). Shaders that cannot be split so return false and are shaded whole.
+		virtual bool shade_deferred(const Scene&, const Camera&, const Intersection&, HDR_rgb&, std::vector<Deferred_Light>&) const {
+			return false;
+		}
+		// Whether nothing blocks the shadow ray to light within [t_min, t_max), by default Scene::occluded()
+		virtual bool light_visible(const Scene& scene, const Light& light, const Ray& ray, real t_min, real t_max) const;
+		// Adds a light's terms, saturating at 1
+		static void add_clamped(HDR_rgb& result, const Light_Term& term) {
+			result.r((result.r() + term.diffuse[0] + term.specular >= 1.0) ? 1.0 : (result.r() + term.diffuse[0] + term.specular));
+			result.g((result.g() + term.diffuse[1] + term.specular >= 1.0) ? 1.0 : (result.g() + term.diffuse[1] + term.specular));
+			result.b((result.b() + term.diffuse[2] + term.specular >= 1.0) ? 1.0 : (result.b() + term.diffuse[2] + term.specular));
+		}
+
 		virtual ~Abstract_Shader() = default;
 	};
 
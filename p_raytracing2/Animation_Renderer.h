@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Scene.h"
+#include "Camera.h"
+#include "Image.h"
+#include "PPM_Writer.h"
+#include "Tile_Renderer.h"
+
+namespace RT {
+
+	struct Animation_Options {
+		size_t frames_in_flight = 2;		// frames whose tiles are queued at once
+		std::string file_prefix = "frame_";	// frame i is written to file_prefix, i padded to digits, ".ppm"
+		size_t digits = 4;
+	};
+
+	// Renders a sequence of frames of one Scene, one per Camera, on a Tile_Renderer's pool. The
+	// scene and its BVHs are built once for the whole sequence. Up to frames_in_flight frames are
+	// queued at a time, so workers finishing the last tiles of one frame move on to the next
+	// instead of idling at the frame boundary, and the worker completing a frame writes it while
+	// the others keep rendering.
+	class Animation_Renderer {
+	public:
+		Animation_Renderer() = delete;
+		Animation_Renderer(const Animation_Renderer&) = delete;
+		Animation_Renderer& operator=(const Animation_Renderer&) = delete;
+		explicit Animation_Renderer(Tile_Renderer& renderer, const Animation_Options& options = Animation_Options())
+			: renderer_(renderer), options_(options) {
+			assert(options_.frames_in_flight > 0);
+		}
+
+		const Animation_Options& options() const { return options_; }
+
+		std::string file_name(size_t frame) const {
+			std::ostringstream name;
+			name << options_.file_prefix << std::setw(options_.digits) << std::setfill('0') << frame << ".ppm";
+			return name.str();
+		}
+
+		// Renders and writes frame i through cameras[i] at the scene's viewport resolution
+		void render(const Scene& scene, const std::vector<Camera>& cameras) {
+			const Viewport& viewport = scene.viewport();
+			std::vector<Tile> tiles = renderer_.tiles(viewport.x_resolution(), viewport.y_resolution());
+			std::mutex mutex;
+			std::condition_variable frame_written;
+			size_t in_flight = 0;
+			for (size_t i = 0; i < cameras.size(); ++i) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					frame_written.wait(lock, [&]() { return in_flight < options_.frames_in_flight; });
+					++in_flight;
+				}
+				// Freed by the worker that writes it
+				Frame* frame = new Frame(cameras[i], viewport.x_resolution(), viewport.y_resolution(), tiles.size());
+				renderer_.submit(scene, frame->camera, frame->image, tiles, [&, frame, i](const Tile&) {
+					if (--frame->tiles_left > 0)
+						return;
+					ppm_writer(frame->image, file_name(i));
+					delete frame;
+					std::lock_guard<std::mutex> lock(mutex);
+					--in_flight;
+					frame_written.notify_one();
+				});
+			}
+			renderer_.pool().wait();
+		}
+
+	private:
+		struct Frame {
+			Frame(const Camera& camera, size_t x_res, size_t y_res, size_t tile_count)
+				: camera(camera), image(x_res, y_res), tiles_left(tile_count) {}
+			Camera camera;
+			Image image;
+			std::atomic<size_t> tiles_left;
+		};
+
+		Tile_Renderer& renderer_;
+		Animation_Options options_;
+	};
+
+}
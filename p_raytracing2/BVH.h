@@ -0,0 +1,548 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "Bounding_Box.h"
+#include "Ray.h"
+#include "Ray_Packet.h"
+#include "Wide_BVH.h"
+
+namespace RT {
+
+	// Node layout used for traversal. The wide layouts are collapsed from the binary tree
+	// and test a ray against 4 or 8 child boxes at once.
+	enum class BVH_Layout { BINARY, WIDE_4, WIDE_8 };
+
+	inline std::ostream& operator<<(std::ostream& out, BVH_Layout layout) {
+		switch (layout) {
+		case BVH_Layout::WIDE_4: return out << "bvh4";
+		case BVH_Layout::WIDE_8: return out << "bvh8";
+		default:				 return out << "binary";
+		}
+	}
+
+	struct BVH_Build_Options {
+		size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+		size_t bin_count = 12;		// more bins find better splits, at a higher build cost
+		size_t max_leaf_size = 8;
+		// Primitives a leaf kernel tests at once, e.g. the SIMD width; the SAH then prices a leaf
+		// by its batches, which favors full leaves over deeper trees
+		size_t leaf_batch_size = 1;
+		BVH_Layout layout = BVH_Layout::BINARY;
+	};
+
+	struct BVH_Statistics {
+		double build_seconds = 0.0;
+		double sah_cost = 0.0;		// expected cost of a ray through the root, in units of one primitive test
+		size_t node_count = 0;
+		size_t leaf_count = 0;
+		size_t max_depth = 0;
+
+		friend std::ostream& operator<<(std::ostream& out, const BVH_Statistics& stats) {
+			return out << "build=" << stats.build_seconds << "s sah_cost=" << stats.sah_cost
+				<< " nodes=" << stats.node_count << " leaves=" << stats.leaf_count << " depth=" << stats.max_depth;
+		}
+	};
+
+	// Bounding volume hierarchy over an array of primitive bounding boxes, built with
+	// the surface area heuristic. The BVH only knows about boxes: traversal hands the
+	// index of every primitive in a visited leaf to a caller supplied function.
+	// Large nodes are binned and partitioned on several threads, and independent
+	// subtrees are built concurrently.
+	class BVH {
+	public:
+		struct Node {
+			Bounding_Box box;
+			uint32_t offset;	// leaf: first entry in primitive_indices(), interior: index of the second child
+			uint32_t count;		// number of primitives in a leaf, 0 for interior nodes
+			uint32_t axis;		// split axis of an interior node
+			bool is_leaf() const { return count > 0; }
+		};
+		using node_storage_type = std::vector<Node>;
+		using index_storage_type = std::vector<uint32_t>;
+
+		static const size_t MAX_BIN_COUNT = 32;
+		static const size_t MAX_SAH_DEPTH = 64;	// deeper nodes are split at the median, bounding the stack below
+		static const size_t STACK_SIZE = 128;
+		static constexpr double TRAVERSAL_COST = 1.0;
+		static constexpr double INTERSECTION_COST = 1.0;
+
+	public:
+		BVH() = default;
+		BVH(const BVH&) = default;
+		BVH(BVH&&) = default;
+		BVH& operator=(const BVH&) = default;
+		BVH& operator=(BVH&&) = default;
+		explicit BVH(const std::vector<Bounding_Box>& boxes, const BVH_Build_Options& options = BVH_Build_Options()) { build(boxes, options); }
+
+		void build(const std::vector<Bounding_Box>& boxes, const BVH_Build_Options& options = BVH_Build_Options()) {
+			assert(options.thread_count > 0);
+			assert(options.bin_count >= 2 && options.bin_count <= MAX_BIN_COUNT);
+			assert(options.max_leaf_size > 0);
+			assert(options.leaf_batch_size > 0);
+			auto start = std::chrono::steady_clock::now();
+			nodes_.clear();
+			indices_.resize(boxes.size());
+			for (size_t i = 0; i < boxes.size(); ++i)
+				indices_[i] = static_cast<uint32_t>(i);
+			if (!boxes.empty()) {
+				std::vector<Point> centroids(boxes.size());
+				for (size_t i = 0; i < boxes.size(); ++i)
+					centroids[i] = boxes[i].centroid();
+				nodes_.reserve(2 * boxes.size());
+				build_recursive(Build_Context{ boxes, centroids, options }, nodes_, 0, boxes.size(), 0);
+			}
+			compute_statistics();
+			layout(options.layout);
+			statistics_.build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		// Takes over a tree produced by an earlier build(), e.g. one read back from a cache
+		void restore(node_storage_type nodes, index_storage_type indices, BVH_Layout new_layout = BVH_Layout::BINARY) {
+			nodes_ = std::move(nodes);
+			indices_ = std::move(indices);
+			compute_statistics();
+			layout(new_layout);
+		}
+
+		// Recomputes every box bottom up, keeping the tree: leaf_box(first, count) bounds the
+		// primitives of a leaf, e.g. after they moved or were stored with less precision
+		template <typename box_function>
+		void refit(box_function leaf_box) {
+			for (size_t i = nodes_.size(); i-- > 0;) {
+				Node& node = nodes_[i];
+				node.box = node.is_leaf() ? leaf_box(node.offset, node.count) : merge(nodes_[i + 1].box, nodes_[node.offset].box);
+			}
+			compute_statistics();
+			layout(layout_);
+		}
+
+		// Switches the traversal layout without rebuilding the tree
+		BVH_Layout layout() const { return layout_; }
+		void layout(BVH_Layout new_layout) {
+			layout_ = new_layout;
+			wide_4_.clear();
+			wide_8_.clear();
+			if (layout_ == BVH_Layout::WIDE_4)
+				wide_4_.build(nodes_);
+			else if (layout_ == BVH_Layout::WIDE_8)
+				wide_8_.build(nodes_);
+		}
+
+		bool is_empty() const { return nodes_.empty(); }
+		size_t node_count() const { return nodes_.size(); }
+		const node_storage_type& nodes() const { return nodes_; }
+		const index_storage_type& primitive_indices() const { return indices_; }
+		const BVH_Statistics& statistics() const { return statistics_; }
+		Bounding_Box bounding_box() const { return nodes_.empty() ? Bounding_Box() : nodes_[0].box; }
+
+		// Replaces primitive_indices() by the identity and returns the old order. For owners
+		// that store their primitives in leaf order, so traverse_leaves() ranges index them directly.
+		index_storage_type take_primitive_order() {
+			index_storage_type order = std::move(indices_);
+			indices_.resize(order.size());
+			for (size_t i = 0; i < indices_.size(); ++i)
+				indices_[i] = static_cast<uint32_t>(i);
+			return order;
+		}
+
+		// Closest hit traversal. leaf_function(primitive, t_max) is called for every primitive
+		// in a leaf the ray reaches, and shrinks t_max when it finds a closer hit.
+		template <typename leaf_function>
+		void traverse(const Ray& ray, real t_min, real& t_max, leaf_function leaf) const {
+			traverse_leaves(ray, t_min, t_max, [&](uint32_t first, uint32_t count, real& t_max) {
+				for (uint32_t i = 0; i < count; ++i)
+					leaf(indices_[first + i], t_max);
+			});
+		}
+
+		// As traverse(), but leaf_function(first, count, t_max) gets the whole range
+		// [first, first + count) of primitive_indices() in a leaf at once
+		template <typename leaf_function>
+		void traverse_leaves(const Ray& ray, real t_min, real& t_max, leaf_function leaf) const {
+			if (layout_ == BVH_Layout::WIDE_4)
+				return wide_4_.traverse(ray, t_min, t_max, leaf);
+			if (layout_ == BVH_Layout::WIDE_8)
+				return wide_8_.traverse(ray, t_min, t_max, leaf);
+			if (nodes_.empty())
+				return;
+			Vector3<real> inv_direction;
+			for (size_t i = 0; i < 3; ++i)
+				inv_direction[i] = 1.0 / ray.direction()[i];
+			traverse_subtree(0, ray.origin(), inv_direction, t_min, t_max, leaf);
+		}
+
+		// Any hit traversal for occlusion queries. leaf_function(primitive) returns true if the
+		// primitive blocks the ray within [t_min, t_max), which ends the traversal.
+		template <typename leaf_function>
+		bool occluded(const Ray& ray, real t_min, real t_max, leaf_function leaf) const {
+			return occluded_leaves(ray, t_min, t_max, [&](uint32_t first, uint32_t count) {
+				for (uint32_t i = 0; i < count; ++i)
+					if (leaf(indices_[first + i]))
+						return true;
+				return false;
+			});
+		}
+
+		// As occluded(), but leaf_function(first, count) gets the whole range of a leaf at once
+		template <typename leaf_function>
+		bool occluded_leaves(const Ray& ray, real t_min, real t_max, leaf_function leaf) const {
+			bool blocked = false;
+			traverse_leaves(ray, t_min, t_max, [&](uint32_t first, uint32_t count, real&) {
+				blocked = leaf(first, count);
+				return blocked;
+			});
+			return blocked;
+		}
+
+		// Packet version of traverse(). leaf_function(primitive, mask) gets the rays of the active
+		// mask whose own slab test reaches the leaf, and shrinks their t_max through the packet.
+		template <typename leaf_function>
+		void traverse(Ray_Packet& packet, real t_min, uint64_t active, leaf_function leaf) const {
+			traverse_leaves(packet, t_min, active, [&](uint32_t first, uint32_t count, uint64_t mask) {
+				for (uint32_t i = 0; i < count; ++i)
+					leaf(indices_[first + i], mask);
+			});
+		}
+
+		// Packet version of traverse_leaves(), for a coherent packet. Each node is first culled for
+		// the whole packet with Ray_Packet::may_intersect(), then the active rays are narrowed to
+		// those entering its box, several at a time. Once only a few rays are left the packet has
+		// stopped being coherent and they continue as single rays. Always walks the binary nodes,
+		// whatever layout() is selected.
+		template <typename leaf_function>
+		void traverse_leaves(Ray_Packet& packet, real t_min, uint64_t active, leaf_function leaf) const {
+			assert(packet.is_coherent());
+			if (nodes_.empty() || active == 0)
+				return;
+			struct Entry { uint32_t node; uint64_t mask; };
+			std::array<Entry, STACK_SIZE> stack;
+			size_t stack_size = 0;
+			stack[stack_size++] = Entry{ 0, active };
+			while (stack_size > 0) {
+				Entry entry = stack[--stack_size];
+				const Node& node = nodes_[entry.node];
+				if (Ray_Packet::bit_count(entry.mask) > PACKET_CULL_SIZE && !packet.may_intersect(node.box, t_min))
+					continue;
+				uint64_t mask = packet.intersect(node.box, t_min, entry.mask);
+				if (mask == 0)
+					continue;
+				if (node.is_leaf()) {
+					leaf(node.offset, node.count, mask);
+				}
+				else if (Ray_Packet::bit_count(mask) <= PACKET_FALLBACK_SIZE) {
+					for (; mask != 0; mask &= mask - 1) {
+						size_t i = lowest_bit(mask);
+						uint64_t single = uint64_t(1) << i;
+						real t_max = packet.t_max(i);
+						traverse_subtree(entry.node, packet.ray(i).origin(), packet.inv_direction(i), t_min, t_max,
+							[&](uint32_t first, uint32_t count, real& t_max) {
+								leaf(first, count, single);
+								t_max = packet.t_max(i);
+							});
+					}
+				}
+				else {
+					// All rays share the direction signs, so the near child is the same for each
+					bool negative = packet.negative(node.axis);
+					stack[stack_size++] = Entry{ negative ? entry.node + 1 : node.offset, mask };
+					stack[stack_size++] = Entry{ negative ? node.offset : entry.node + 1, mask };
+				}
+			}
+		}
+
+	private:
+		static const size_t PARALLEL_THRESHOLD = 4096;	// smallest range worth handing to another thread
+		static const size_t PACKET_FALLBACK_SIZE = 2;	// packets with this few active rays are traced ray by ray
+		static const size_t PACKET_CULL_SIZE = 16;		// smaller packets are tested ray by ray right away
+
+		// Single ray traversal of the binary nodes below root
+		template <typename leaf_function>
+		void traverse_subtree(uint32_t root, const Point& origin, const Vector3<real>& inv_direction, real t_min, real& t_max, leaf_function leaf) const {
+			std::array<bool, 3> negative;
+			for (size_t i = 0; i < 3; ++i)
+				negative[i] = inv_direction[i] < 0.0;
+
+			std::array<uint32_t, STACK_SIZE> stack;
+			size_t stack_size = 0;
+			uint32_t current = root;
+			while (true) {
+				const Node& node = nodes_[current];
+				if (node.box.intersect(origin, inv_direction, t_min, t_max)) {
+					if (node.is_leaf()) {
+						if (visit_leaf(leaf, node.offset, node.count, t_max))
+							return;
+					}
+					else {
+						// Visit the child on the ray's side of the split first
+						if (negative[node.axis]) {
+							stack[stack_size++] = current + 1;
+							current = node.offset;
+						}
+						else {
+							stack[stack_size++] = node.offset;
+							current = current + 1;
+						}
+						continue;
+					}
+				}
+				if (stack_size == 0)
+					break;
+				current = stack[--stack_size];
+			}
+		}
+
+
+		struct Bin {
+			Bounding_Box box;
+			size_t count = 0;
+		};
+		struct Build_Context {
+			const std::vector<Bounding_Box>& boxes;
+			const std::vector<Point>& centroids;
+			const BVH_Build_Options& options;
+		};
+
+		// Runs function(chunk, begin, end) over chunk_count slices of [begin, end), the first on this thread
+		template <typename chunk_function>
+		static void parallel_chunks(size_t begin, size_t end, size_t chunk_count, chunk_function function) {
+			std::vector<std::thread> threads;
+			size_t chunk_size = (end - begin + chunk_count - 1) / chunk_count;
+			for (size_t c = 1; c < chunk_count; ++c) {
+				size_t chunk_begin = std::min(end, begin + c * chunk_size);
+				size_t chunk_end = std::min(end, chunk_begin + chunk_size);
+				threads.emplace_back([=, &function]() { function(c, chunk_begin, chunk_end); });
+			}
+			function(0, begin, std::min(end, begin + chunk_size));
+			for (auto& t : threads)
+				t.join();
+		}
+
+		// Nodes near the root get a share of the threads, deeper ones are built serially
+		static size_t threads_at_depth(const Build_Context& context, size_t count, size_t depth) {
+			if (depth >= 32 || count < 2 * PARALLEL_THRESHOLD)
+				return 1;
+			size_t threads = context.options.thread_count >> depth;
+			return std::max<size_t>(1, std::min(threads, count / PARALLEL_THRESHOLD));
+		}
+
+		// Leaf kernel runs needed for count primitives
+		static double batches(size_t count, const BVH_Build_Options& options) {
+			return static_cast<double>((count + options.leaf_batch_size - 1) / options.leaf_batch_size);
+		}
+
+		static uint32_t make_leaf(node_storage_type& nodes, const Bounding_Box& box, size_t begin, size_t end) {
+			nodes.push_back(Node{ box, static_cast<uint32_t>(begin), static_cast<uint32_t>(end - begin), 0 });
+			return static_cast<uint32_t>(nodes.size() - 1);
+		}
+
+		// Builds the subtree over indices_[begin, end) depth first into nodes, so the first
+		// child of an interior node always directly follows it. Interior offsets are relative
+		// to the start of nodes, which lets subtrees built on other threads be spliced in.
+		uint32_t build_recursive(const Build_Context& context, node_storage_type& nodes, size_t begin, size_t end, size_t depth) {
+			const auto& boxes = context.boxes;
+			const auto& centroids = context.centroids;
+			size_t count = end - begin;
+			size_t threads = threads_at_depth(context, count, depth);
+
+			Bounding_Box box, centroid_box;
+			if (threads > 1) {
+				std::vector<Bounding_Box> chunk_boxes(threads), chunk_centroid_boxes(threads);
+				parallel_chunks(begin, end, threads, [&](size_t c, size_t chunk_begin, size_t chunk_end) {
+					for (size_t i = chunk_begin; i < chunk_end; ++i) {
+						chunk_boxes[c].expand(boxes[indices_[i]]);
+						chunk_centroid_boxes[c].expand(centroids[indices_[i]]);
+					}
+				});
+				for (size_t c = 0; c < threads; ++c) {
+					box.expand(chunk_boxes[c]);
+					centroid_box.expand(chunk_centroid_boxes[c]);
+				}
+			}
+			else {
+				for (size_t i = begin; i < end; ++i) {
+					box.expand(boxes[indices_[i]]);
+					centroid_box.expand(centroids[indices_[i]]);
+				}
+			}
+			if (count == 1)
+				return make_leaf(nodes, box, begin, end);
+
+			// Bin the centroids along the widest axis and sweep for the cheapest split
+			size_t axis = centroid_box.largest_axis();
+			double axis_min = centroid_box.min()[axis];
+			double axis_extent = centroid_box.max()[axis] - axis_min;
+			if (axis_extent <= 0.0 || depth >= MAX_SAH_DEPTH) {
+				if (count <= context.options.max_leaf_size)
+					return make_leaf(nodes, box, begin, end);
+				return split_median(context, nodes, box, axis, begin, end, depth);
+			}
+			size_t bin_count = context.options.bin_count;
+			auto bin_of = [&](uint32_t primitive) {
+				size_t b = static_cast<size_t>(bin_count * ((centroids[primitive][axis] - axis_min) / axis_extent));
+				return (b < bin_count) ? b : bin_count - 1;
+			};
+			std::array<Bin, MAX_BIN_COUNT> bins;
+			if (threads > 1) {
+				std::vector<std::array<Bin, MAX_BIN_COUNT>> chunk_bins(threads);
+				parallel_chunks(begin, end, threads, [&](size_t c, size_t chunk_begin, size_t chunk_end) {
+					for (size_t i = chunk_begin; i < chunk_end; ++i) {
+						Bin& bin = chunk_bins[c][bin_of(indices_[i])];
+						bin.box.expand(boxes[indices_[i]]);
+						++bin.count;
+					}
+				});
+				for (size_t c = 0; c < threads; ++c) {
+					for (size_t b = 0; b < bin_count; ++b) {
+						bins[b].box.expand(chunk_bins[c][b].box);
+						bins[b].count += chunk_bins[c][b].count;
+					}
+				}
+			}
+			else {
+				for (size_t i = begin; i < end; ++i) {
+					Bin& bin = bins[bin_of(indices_[i])];
+					bin.box.expand(boxes[indices_[i]]);
+					++bin.count;
+				}
+			}
+			std::array<double, MAX_BIN_COUNT - 1> cost;
+			Bounding_Box below;
+			size_t below_count = 0;
+			for (size_t i = 0; i < bin_count - 1; ++i) {
+				below.expand(bins[i].box);
+				below_count += bins[i].count;
+				cost[i] = batches(below_count, context.options) * below.surface_area();
+			}
+			Bounding_Box above;
+			size_t above_count = 0;
+			for (size_t i = bin_count - 1; i > 0; --i) {
+				above.expand(bins[i].box);
+				above_count += bins[i].count;
+				cost[i - 1] += batches(above_count, context.options) * above.surface_area();
+			}
+			size_t best_split = 0;
+			for (size_t i = 1; i < bin_count - 1; ++i) {
+				if (cost[i] < cost[best_split])
+					best_split = i;
+			}
+			double split_cost = TRAVERSAL_COST + INTERSECTION_COST * cost[best_split] / box.surface_area();
+			double leaf_cost = INTERSECTION_COST * batches(count, context.options);
+			if (count <= context.options.max_leaf_size && leaf_cost <= split_cost)
+				return make_leaf(nodes, box, begin, end);
+
+			auto is_below = [&](uint32_t primitive) { return bin_of(primitive) <= best_split; };
+			size_t mid = (threads > 1)
+				? parallel_partition(begin, end, threads, is_below)
+				: std::stable_partition(indices_.begin() + begin, indices_.begin() + end, is_below) - indices_.begin();
+			if (mid == begin || mid == end)
+				return split_median(context, nodes, box, axis, begin, end, depth);
+			return make_interior(context, nodes, box, axis, begin, mid, end, depth);
+		}
+
+		// Stable, like the serial path, so the tree does not depend on the thread count
+		template <typename predicate>
+		size_t parallel_partition(size_t begin, size_t end, size_t threads, predicate is_below) {
+			std::vector<size_t> below_counts(threads, 0), above_counts(threads, 0);
+			parallel_chunks(begin, end, threads, [&](size_t c, size_t chunk_begin, size_t chunk_end) {
+				for (size_t i = chunk_begin; i < chunk_end; ++i)
+					++(is_below(indices_[i]) ? below_counts[c] : above_counts[c]);
+			});
+			size_t total_below = 0;
+			for (size_t c = 0; c < threads; ++c)
+				total_below += below_counts[c];
+			std::vector<size_t> below_starts(threads), above_starts(threads);
+			for (size_t c = 0, below = 0, above = total_below; c < threads; ++c) {
+				below_starts[c] = below;
+				above_starts[c] = above;
+				below += below_counts[c];
+				above += above_counts[c];
+			}
+			index_storage_type partitioned(end - begin);
+			parallel_chunks(begin, end, threads, [&](size_t c, size_t chunk_begin, size_t chunk_end) {
+				size_t below = below_starts[c], above = above_starts[c];
+				for (size_t i = chunk_begin; i < chunk_end; ++i)
+					partitioned[is_below(indices_[i]) ? below++ : above++] = indices_[i];
+			});
+			std::copy(partitioned.begin(), partitioned.end(), indices_.begin() + begin);
+			return begin + total_below;
+		}
+
+		uint32_t split_median(const Build_Context& context, node_storage_type& nodes,
+			const Bounding_Box& box, size_t axis, size_t begin, size_t end, size_t depth) {
+			const auto& centroids = context.centroids;
+			size_t mid = (begin + end) / 2;
+			std::nth_element(indices_.begin() + begin, indices_.begin() + mid, indices_.begin() + end,
+				[&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+			return make_interior(context, nodes, box, axis, begin, mid, end, depth);
+		}
+
+		uint32_t make_interior(const Build_Context& context, node_storage_type& nodes,
+			const Bounding_Box& box, size_t axis, size_t begin, size_t mid, size_t end, size_t depth) {
+			uint32_t index = static_cast<uint32_t>(nodes.size());
+			nodes.push_back(Node{ box, 0, 0, static_cast<uint32_t>(axis) });
+			if (threads_at_depth(context, end - begin, depth) > 1) {
+				// Build the first subtree on another thread and splice both in afterwards
+				node_storage_type first_nodes, second_nodes;
+				std::thread first([&]() { build_recursive(context, first_nodes, begin, mid, depth + 1); });
+				build_recursive(context, second_nodes, mid, end, depth + 1);
+				first.join();
+				append(nodes, first_nodes);
+				nodes[index].offset = static_cast<uint32_t>(nodes.size());
+				append(nodes, second_nodes);
+			}
+			else {
+				build_recursive(context, nodes, begin, mid, depth + 1);
+				nodes[index].offset = build_recursive(context, nodes, mid, end, depth + 1);
+			}
+			return index;
+		}
+
+		static void append(node_storage_type& nodes, const node_storage_type& subtree) {
+			uint32_t base = static_cast<uint32_t>(nodes.size());
+			for (Node node : subtree) {
+				if (!node.is_leaf())
+					node.offset += base;
+				nodes.push_back(node);
+			}
+		}
+
+		void compute_statistics() {
+			statistics_ = BVH_Statistics();
+			statistics_.node_count = nodes_.size();
+			if (nodes_.empty())
+				return;
+			double root_area = nodes_[0].box.surface_area();
+			std::vector<std::pair<uint32_t, size_t>> stack{ { 0, 0 } };
+			while (!stack.empty()) {
+				auto [index, depth] = stack.back();
+				stack.pop_back();
+				const Node& node = nodes_[index];
+				double area = (root_area > 0.0) ? node.box.surface_area() / root_area : 1.0;
+				statistics_.max_depth = std::max(statistics_.max_depth, depth);
+				if (node.is_leaf()) {
+					++statistics_.leaf_count;
+					statistics_.sah_cost += INTERSECTION_COST * node.count * area;
+				}
+				else {
+					statistics_.sah_cost += TRAVERSAL_COST * area;
+					stack.push_back({ index + 1, depth + 1 });
+					stack.push_back({ node.offset, depth + 1 });
+				}
+			}
+		}
+
+		node_storage_type nodes_;
+		index_storage_type indices_;
+		BVH_Statistics statistics_;
+		BVH_Layout layout_ = BVH_Layout::BINARY;
+		Wide_BVH<4> wide_4_;
+		Wide_BVH<8> wide_8_;
+	};
+
+}
\ No newline at end of file
@@ -1,18 +1,26 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include "Abstract_Shader.h"
 #include "HDR_RGB.h"
 #include "Intersection.h"
 #include "Camera.h"
+#include "Light_BVH.h"
+#include "SIMD.h"
+#include "Occluder_Cache.h"
 
 namespace RT {
 
 	class Blinn_Phong_Shader : public Abstract_Shader {
 	public:
+		// Hits shade_batch() evaluates the Lambert and Blinn terms of at once
+		static const size_t BATCH_WIDTH = 8;
+
 		Blinn_Phong_Shader() = delete;
 		Blinn_Phong_Shader(const Blinn_Phong_Shader&) = default;
 		Blinn_Phong_Shader(Blinn_Phong_Shader&&) = default;
-		Blinn_Phong_Shader(double ambient_coefficient, const HDR_rgb& ambient_color, double diffuse_coefficient, double specular_coefficient)
+		Blinn_Phong_Shader(real ambient_coefficient, const HDR_rgb& ambient_color, real diffuse_coefficient, real specular_coefficient)
 			: ambient_coefficient_(ambient_coefficient), ambient_color_(ambient_color), 
 			diffuse_coefficient_(diffuse_coefficient), specular_coefficient_(specular_coefficient) {
 			assert(ambient_coefficient  >= 0.0);
@@ -20,56 +28,223 @@ namespace RT {
 			assert(specular_coefficient >= 0.0);
 		}
 
-		double ambient_coefficient() const { return ambient_coefficient_; }
+		real ambient_coefficient() const { return ambient_coefficient_; }
 		const HDR_rgb& ambient_color() const { return ambient_color_; }
-		double diffuse_coefficient() const { return diffuse_coefficient_; }
-		double specular_coefficient() const { return specular_coefficient_; }
+		real diffuse_coefficient() const { return diffuse_coefficient_; }
+		real specular_coefficient() const { return specular_coefficient_; }
+
+		// With falloff every light's terms are scaled by its contribution at the shading point,
+		// intensity / distance^2 (see Light_BVH). Off by default, where the lights are as bright at
+		// any distance; a light threshold or light samples turn it on, as they rank lights by it.
+		bool light_falloff() const { return light_falloff_ || light_threshold_ > 0.0 || light_samples_ > 0; }
+		void light_falloff(bool falloff) { light_falloff_ = falloff; }
+		// Lights whose contribution at a shading point is below threshold are skipped, 0 shades
+		// every light. A skipped light would have added at most threshold * (diffuse + specular
+		// coefficient) to each channel.
+		real light_threshold() const { return light_threshold_; }
+		void light_threshold(real threshold) { assert(threshold >= 0.0); light_threshold_ = threshold; }
+		// With samples > 0 and more lights than that, each shading point traces shadow rays to
+		// that many lights drawn from the scene's Light_BVH, weighted by their probability,
+		// instead of one to every light. The weighted terms are unbiased, but the sum saturates
+		// at 1 after every light, so bright points come out darker on average, and noisy.
+		size_t light_samples() const { return light_samples_; }
+		void light_samples(size_t samples) { light_samples_ = samples; }
+		// Off by default. When on, shadow rays test the thread's Occluder_Cache first, which pays
+		// only where neighbouring shading points are blocked by the same primitive
+		bool occluder_cache() const { return occluder_cache_; }
+		void occluder_cache(bool use) { occluder_cache_ = use; }
+		bool occluded(const Scene& scene, const Light& light, const Ray& ray, real t_min, real t_max) const {
+			if (occluder_cache_)
+				return Occluder_Cache::local().occluded(scene, light, ray, t_min, t_max);
+			return scene.occluded(ray, t_min, t_max);
+		}
+
+		// Calls f(light, weight) for the lights shading p, weight scaling the light's terms
+		template <class F>
+		void for_each_light(const Scene& scene, const Point& p, F f) const {
+			if (samples_lights(scene)) {
+				for (size_t i = 0; i < light_samples_; ++i) {
+					real pdf;
+					const Light* light = scene.light_bvh().sample(p, Light_BVH::random(p, i), pdf);
+					if (light && pdf > 0 && Light_BVH::contribution(*light, p) >= light_threshold_)
+						f(*light, 1 / (light_samples_ * pdf));
+				}
+			}
+			else if (light_threshold_ > 0.0) {
+				scene.light_bvh().for_each_light(p, light_threshold_, [&](const Light& light) { f(light, real(1)); });
+			}
+			else {
+				for (size_t i = 0; i < scene.lights().size(); ++i)
+					f(scene.light(i), real(1));
+			}
+		}
 
 		HDR_rgb shade(const Scene& scene, const Camera& camera, const Intersection& intersection) const {
-			// Ambient
-			HDR_rgb result
+			HDR_rgb result = ambient(intersection);
+			for_each_light(scene, intersection.location(), [&](const Light& light, real weight) {
+				// Shadow
+				Direction to_light = light.location() - intersection.location();
+				Ray  ray(intersection.location(), to_light);
+				if (occluded(scene, light, ray, ray_epsilon(intersection.location()), to_light.magnitude())) {
+					return;
+				}
+				Light_Term term;
+				direct(camera, intersection, light, term, weight);
+				add_clamped(result, term);
+			});
+			return result;
+		}
+
+		// The colours of shade(). With every light shading every point, runs of up to BATCH_WIDTH
+		// hits on one object are shaded light by light, their terms computed lane by lane so the
+		// compiler can vectorise them; the view directions and ambient term are found once per run.
+		// Falloff, thresholds and sampling differ per point, so those points are shaded one by one.
+		void shade_batch(const Scene& scene, const Camera& camera, const Intersection* intersections, size_t count, HDR_rgb* colors) const {
+			if (light_falloff()) {
+				Abstract_Shader::shade_batch(scene, camera, intersections, count, colors);
+				return;
+			}
+			for (size_t first = 0, end; first < count; first = end) {
+				const Abstract_Object& object = intersections[first].object();
+				for (end = first + 1; end < count && end - first < BATCH_WIDTH && &intersections[end].object() == &object; ++end) {}
+				shade_lanes(scene, camera, intersections + first, end - first, colors + first);
+			}
+		}
+
+		// The terms of shade() on their own, for renderers that trace the shadow rays separately
+		HDR_rgb ambient(const Intersection& intersection) const {
+			return HDR_rgb
 			   (intersection.object().color().r()*ambient_color_.r()*ambient_coefficient_,
 				intersection.object().color().g()*ambient_color_.g()*ambient_coefficient_,
 				intersection.object().color().b()*ambient_color_.b()*ambient_coefficient_);
+		}
+		// Lambertian colour and Blinn highlight of an unoccluded light, scaled by weight and by the
+		// falloff if that is on. Not clamped, a weighted or close light may exceed 1.
+		void direct(const Camera& camera, const Intersection& intersection, const Light& light, Light_Term& term,
+			real weight = 1.0) const {
+			// Lambertian
+			Vector3<real> l = (light.location() - intersection.normal()).normalized();
+			real temp = fmax(0, (intersection.normal()*l));
+			term.diffuse[0] = intersection.object().color().r()*temp*diffuse_coefficient_;
+			term.diffuse[1] = intersection.object().color().g()*temp*diffuse_coefficient_;
+			term.diffuse[2] = intersection.object().color().b()*temp*diffuse_coefficient_;
+			// Blinn
+			Vector3<real> v = (camera.origin() - intersection.location()).normalized();
+			auto h = (l + v).normalized();
+			temp = fmax(0, (intersection.normal()*h));
+			temp = pow(temp, intersection.object().shininess());
+			term.specular = specular_coefficient_*temp;
+			real scale = light_falloff() ? weight * Light_BVH::contribution(light, intersection.location()) : weight;
+			if (scale != 1.0) {
+				for (real& diffuse : term.diffuse)
+					diffuse *= scale;
+				term.specular *= scale;
+			}
+		}
+
+		// The ambient term, then direct() for every light for_each_light() picks
+		bool shade_deferred(const Scene& scene, const Camera& camera, const Intersection& intersection, HDR_rgb& color,
+			std::vector<Deferred_Light>& lights) const {
+			color = ambient(intersection);
+			for_each_light(scene, intersection.location(), [&](const Light& light, real weight) {
+				lights.push_back(Deferred_Light{ &light, Light_Term() });
+				direct(camera, intersection, light, lights.back().term, weight);
+			});
+			return true;
+		}
+		bool light_visible(const Scene& scene, const Light& light, const Ray& ray, real t_min, real t_max) const {
+			return !occluded(scene, light, ray, t_min, t_max);
+		}
+
+	private:
+		bool samples_lights(const Scene& scene) const { return light_samples_ > 0 && light_samples_ < scene.light_bvh().size(); }
+
+		// Lanes are up to BATCH_WIDTH hits on one object; unused lanes repeat the last hit. The
+		// arithmetic is that of direct() and add_clamped(), step for step, so the colours match.
+		void shade_lanes(const Scene& scene, const Camera& camera, const Intersection* intersections, size_t width, HDR_rgb* colors) const {
+			const size_t W = BATCH_WIDTH;
+			const Abstract_Object& object = intersections[0].object();
+			real p[3][W], n[3][W], v[3][W], l[3][W], h[3][W], result[3][W], length[W], lambert[W], blinn[W];
+			bool visible[W];
+			for (size_t k = 0; k < W; ++k) {
+				const Intersection& intersection = intersections[std::min(k, width - 1)];
+				for (size_t axis = 0; axis < 3; ++axis) {
+					p[axis][k] = intersection.location()[axis];
+					n[axis][k] = intersection.normal()[axis];
+				}
+			}
+			for (size_t k = 0; k < W; ++k) {
+				for (size_t axis = 0; axis < 3; ++axis)
+					v[axis][k] = camera.origin()[axis] - p[axis][k];
+				length[k] = v[0][k] * v[0][k] + v[1][k] * v[1][k] + v[2][k] * v[2][k];
+			}
+			sqrt_lanes(length, W);
+			for (size_t k = 0; k < W; ++k)
+				for (size_t axis = 0; axis < 3; ++axis)
+					v[axis][k] /= length[k];
+			HDR_rgb ambient_term = ambient(intersections[0]);
+			for (size_t k = 0; k < W; ++k) {
+				result[0][k] = ambient_term.r();
+				result[1][k] = ambient_term.g();
+				result[2][k] = ambient_term.b();
+			}
+			const real color[3] = { object.color().r(), object.color().g(), object.color().b() };
 			for (size_t i = 0; i < scene.lights().size(); ++i) {
 				const Light& light = scene.light(i);
-				// Shadow
-				Direction direction_ = (light.location() - intersection.location()).normalized();
-				Ray  ray(intersection.location(), direction_);
-				std::optional<Intersection> inter = scene.intersect(ray, 0.01);
-				if (inter != std::nullopt) {
-					auto dist_0 = (light.location() -  intersection.location()).magnitude_squared();
-					auto dist_1 = (inter->location() - intersection.location()).magnitude_squared();
-					if (dist_0 > dist_1) {
-						continue;
+				bool any_visible = false;
+				for (size_t k = 0; k < width; ++k) {
+					Direction to_light = light.location() - intersections[k].location();
+					Ray ray(intersections[k].location(), to_light);
+					visible[k] = !occluded(scene, light, ray, ray_epsilon(intersections[k].location()), to_light.magnitude());
+					any_visible = any_visible || visible[k];
+				}
+				if (!any_visible)
+					continue;
+				const real light_location[3] = { light.location()[0], light.location()[1], light.location()[2] };
+				for (size_t k = 0; k < W; ++k) {
+					// As in direct(), l runs from the normal, not the hit point, to the light
+					l[0][k] = light_location[0] - n[0][k];
+					l[1][k] = light_location[1] - n[1][k];
+					l[2][k] = light_location[2] - n[2][k];
+					length[k] = l[0][k] * l[0][k] + l[1][k] * l[1][k] + l[2][k] * l[2][k];
+				}
+				sqrt_lanes(length, W);
+				for (size_t k = 0; k < W; ++k) {
+					real lx = l[0][k] / length[k], ly = l[1][k] / length[k], lz = l[2][k] / length[k];
+					lambert[k] = positive(n[0][k] * lx + n[1][k] * ly + n[2][k] * lz);
+					h[0][k] = lx + v[0][k];
+					h[1][k] = ly + v[1][k];
+					h[2][k] = lz + v[2][k];
+					length[k] = h[0][k] * h[0][k] + h[1][k] * h[1][k] + h[2][k] * h[2][k];
+				}
+				sqrt_lanes(length, W);
+				for (size_t k = 0; k < W; ++k)
+					blinn[k] = positive(n[0][k] * (h[0][k] / length[k]) + n[1][k] * (h[1][k] / length[k]) + n[2][k] * (h[2][k] / length[k]));
+				for (size_t k = 0; k < width; ++k)
+					blinn[k] = specular_coefficient_ * std::pow(blinn[k], object.shininess());
+				for (size_t channel = 0; channel < 3; ++channel) {
+					for (size_t k = 0; k < width; ++k) {
+						real sum = result[channel][k] + color[channel] * lambert[k] * diffuse_coefficient_ + blinn[k];
+						if (visible[k])
+							result[channel][k] = (sum >= 1.0) ? 1.0 : sum;
 					}
 				}
-				// Lambertian
-				Vector3<double> l = (light.location() - intersection.normal()).normalized();
-				double temp = fmax(0, (intersection.normal()*l));
-				HDR_rgb lambert
-				   (intersection.object().color().r()*temp*diffuse_coefficient_,
-					intersection.object().color().g()*temp*diffuse_coefficient_,
-					intersection.object().color().b()*temp*diffuse_coefficient_);
-				// Blinn
-				Vector3<double> v = (camera.origin() - intersection.location()).normalized();
-				auto h = (l + v).normalized();
-				temp = fmax(0, (intersection.normal()*h));
-				temp = pow(temp, intersection.object().shininess());
-				HDR_rgb blinn(specular_coefficient_*temp, specular_coefficient_*temp, specular_coefficient_*temp);
-				// Add them together
-				result.r((result.r() + lambert.r() + blinn.r() >= 1.0) ? 1.0 : (result.r() + lambert.r() + blinn.r()));
-				result.g((result.g() + lambert.g() + blinn.g() >= 1.0) ? 1.0 : (result.g() + lambert.g() + blinn.g()));
-				result.b((result.b() + lambert.b() + blinn.b() >= 1.0) ? 1.0 : (result.b() + lambert.b() + blinn.b()));
 			}
-			return result;
+			for (size_t k = 0; k < width; ++k)
+				colors[k] = HDR_rgb(result[0][k], result[1][k], result[2][k]);
 		}
 
-	private:
-		double ambient_coefficient_;
+		// fmax(0, x) without the library call, which keeps loops from vectorising
+		static real positive(real x) { return (x > 0) ? x : real(0); }
+
+		real ambient_coefficient_;
 		HDR_rgb ambient_color_;
-		double diffuse_coefficient_;
-		double specular_coefficient_;
+		real diffuse_coefficient_;
+		real specular_coefficient_;
+		real light_threshold_ = 0.0;
+		size_t light_samples_ = 0;
+		bool light_falloff_ = false;
+		bool occluder_cache_ = false;
 	};
 
 }
\ No newline at end of file
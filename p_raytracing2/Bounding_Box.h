@@ -0,0 +1,79 @@
+#pragma once
+#include <algorithm>
+#include <iostream>
+#include "Vector.h"
+#include "Misc.h"
+
+namespace RT {
+
+	class Bounding_Box {
+	public:
+		// Constructor, Assignment
+		Bounding_Box() : min_(REAL_INFINITY), max_(REAL_NEGATIVE_INFINITY) {}
+		Bounding_Box(const Bounding_Box& box) = default;
+		Bounding_Box& operator=(const Bounding_Box& box) = default;
+		Bounding_Box(const Point& min, const Point& max) : min_(min), max_(max) {}
+		explicit Bounding_Box(const Point& point) : min_(point), max_(point) {}
+
+		// Accessors
+		const Point& min() const { return min_; }
+		const Point& max() const { return max_; }
+		bool is_empty() const { return min_[0] > max_[0] || min_[1] > max_[1] || min_[2] > max_[2]; }
+		Point centroid() const { return (min_ + max_) * 0.5; }
+		Vector3<real> extent() const { return max_ - min_; }
+		real surface_area() const {
+			if (is_empty())
+				return 0.0;
+			Vector3<real> e = extent();
+			return 2.0 * (e[0] * e[1] + e[1] * e[2] + e[2] * e[0]);
+		}
+		size_t largest_axis() const {
+			Vector3<real> e = extent();
+			if (e[0] >= e[1] && e[0] >= e[2])
+				return 0;
+			return (e[1] >= e[2]) ? 1 : 2;
+		}
+
+		// Growing the box
+		void expand(const Point& point) {
+			for (size_t i = 0; i < 3; ++i) {
+				min_[i] = std::min(min_[i], point[i]);
+				max_[i] = std::max(max_[i], point[i]);
+			}
+		}
+		void expand(const Bounding_Box& box) {
+			for (size_t i = 0; i < 3; ++i) {
+				min_[i] = std::min(min_[i], box.min_[i]);
+				max_[i] = std::max(max_[i], box.max_[i]);
+			}
+		}
+		friend Bounding_Box merge(const Bounding_Box& lhs, const Bounding_Box& rhs) {
+			Bounding_Box result(lhs);
+			result.expand(rhs);
+			return result;
+		}
+
+		// Slab test, inv_direction is the componentwise reciprocal of the ray direction
+		bool intersect(const Point& origin, const Vector3<real>& inv_direction, real t_min, real t_max) const {
+			for (size_t i = 0; i < 3; ++i) {
+				real t0 = (min_[i] - origin[i]) * inv_direction[i];
+				real t1 = (max_[i] - origin[i]) * inv_direction[i];
+				if (t0 > t1)
+					std::swap(t0, t1);
+				t_min = (t0 > t_min) ? t0 : t_min;
+				t_max = (t1 < t_max) ? t1 : t_max;
+				if (t_min > t_max)
+					return false;
+			}
+			return true;
+		}
+
+		friend std::ostream& operator<<(std::ostream& out, const Bounding_Box& box) {
+			return out << "min=" << box.min() << " max=" << box.max();
+		}
+
+	private:
+		Point min_, max_;
+	};
+
+}
\ No newline at end of file
@@ -11,9 +11,9 @@ namespace RT {
 		Camera(const Camera& cam) = default;
 		Camera& operator=(const Camera& cam) = default;
 		Camera(const Point& origin, const Direction& u, const Direction& v, const Direction& w) : origin_(origin), u_(u), v_(v), w_(w) {
-			assert(approx_equal(u_.magnitude(), 1.0, 0.1));
-			assert(approx_equal(v_.magnitude(), 1.0, 0.1));
-			assert(approx_equal(w_.magnitude(), 1.0, 0.1));
+			assert(approx_equal(u_.magnitude(), real(1.0), real(0.1)));
+			assert(approx_equal(v_.magnitude(), real(1.0), real(0.1)));
+			assert(approx_equal(w_.magnitude(), real(1.0), real(0.1)));
 		}
 		Camera(const Point& origin, const Direction& view_direction, const Direction& up) : origin_(origin) {
 			w_ = (-view_direction).normalized();
@@ -0,0 +1,116 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Vector.h"
+#include "Camera.h"
+#include "Bounding_Box.h"
+
+namespace RT {
+
+	// Camera keyframes over time. Eye and look at point follow Catmull-Rom splines through the
+	// keys, so the path passes through every key without corners; before the first and after
+	// the last key the camera holds still.
+	class Camera_Path {
+	public:
+		struct Key {
+			real time;
+			Point eye;
+			Point target;
+			Direction up;
+		};
+
+	public:
+		Camera_Path() = default;
+
+		// Keys must be added in increasing time
+		void add_key(real time, const Point& eye, const Point& target, const Direction& up = Direction({ 0.0, 1.0, 0.0 })) {
+			assert(keys_.empty() || keys_.back().time < time);
+			keys_.push_back({ time, eye, target, up });
+		}
+		const std::vector<Key>& keys() const { return keys_; }
+		bool empty() const { return keys_.empty(); }
+		real start_time() const { assert(!empty()); return keys_.front().time; }
+		real end_time() const { assert(!empty()); return keys_.back().time; }
+
+		Camera camera(real time) const {
+			assert(!empty());
+			if (time <= keys_.front().time || keys_.size() == 1)
+				return camera(keys_.front().eye, keys_.front().target, keys_.front().up);
+			if (time >= keys_.back().time)
+				return camera(keys_.back().eye, keys_.back().target, keys_.back().up);
+			size_t i = std::upper_bound(keys_.begin(), keys_.end(), time, [](real t, const Key& key) { return t < key.time; }) - keys_.begin() - 1;
+			const Key& k1 = keys_[i];
+			const Key& k2 = keys_[i + 1];
+			const Key& k0 = keys_[(i > 0) ? i - 1 : i];
+			const Key& k3 = keys_[std::min(i + 2, keys_.size() - 1)];
+			real s = (time - k1.time) / (k2.time - k1.time);
+			Point eye = spline(k0.eye, k1.eye, k2.eye, k3.eye, s);
+			Point target = spline(k0.target, k1.target, k2.target, k3.target, s);
+			return camera(eye, target, k1.up * (1 - s) + k2.up * s);
+		}
+
+		// count cameras evenly spaced from the first to the last key
+		std::vector<Camera> frames(size_t count) const {
+			std::vector<Camera> result;
+			result.reserve(count);
+			for (size_t i = 0; i < count; ++i)
+				result.push_back(camera(start_time() + (end_time() - start_time()) * ((count > 1) ? real(i) / (count - 1) : real(0))));
+			return result;
+		}
+
+		// Circle around box at height above its centre, looking at the centre, one key per
+		// quarter turn from time 0 to 1
+		static Camera_Path orbit(const Bounding_Box& box, real distance, real height) {
+			Camera_Path path;
+			Point center = box.centroid();
+			for (size_t i = 0; i <= 4; ++i) {
+				real angle = real(2 * 3.14159265358979323846) * i / 4;
+				path.add_key(real(i) / 4, center + Direction({ distance * std::cos(angle), height, distance * std::sin(angle) }), center);
+			}
+			return path;
+		}
+
+		// Text file of keys, one per line: time eye_x eye_y eye_z target_x target_y target_z
+		// [up_x up_y up_z]; blank lines and lines starting with # are skipped
+		bool load(const std::string& file_name) {
+			std::ifstream in(file_name);
+			if (!in)
+				return false;
+			std::vector<Key> keys;
+			std::string line;
+			while (std::getline(in, line)) {
+				std::istringstream fields(line);
+				Key key{ 0.0, Point(), Point(), Direction({ 0.0, 1.0, 0.0 }) };
+				if (!(fields >> key.time))
+					continue;	// blank or comment
+				if (!(fields >> key.eye[0] >> key.eye[1] >> key.eye[2] >> key.target[0] >> key.target[1] >> key.target[2]))
+					return false;
+				real up[3];
+				if (fields >> up[0] >> up[1] >> up[2])
+					key.up = Direction({ up[0], up[1], up[2] });
+				if (!keys.empty() && !(keys.back().time < key.time))
+					return false;
+				keys.push_back(key);
+			}
+			keys_ = keys;
+			return !keys_.empty();
+		}
+
+	private:
+		static Camera camera(const Point& eye, const Point& target, const Direction& up) {
+			return Camera(eye, target - eye, up);
+		}
+		static Point spline(const Point& p0, const Point& p1, const Point& p2, const Point& p3, real s) {
+			real s2 = s * s, s3 = s2 * s;
+			return ((p1 * 2) + (p2 - p0) * s + (p0 * 2 - p1 * 5 + p2 * 4 - p3) * s2 + (p1 * 3 - p0 - p2 * 3 + p3) * s3) * real(0.5);
+		}
+
+		std::vector<Key> keys_;
+	};
+
+}
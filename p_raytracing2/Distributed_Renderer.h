@@ -0,0 +1,292 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "Scene.h"
+#include "Image.h"
+#include "Tile_Renderer.h"
+#ifndef _WIN32
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace RT {
+
+	struct Distributed_Options {
+		size_t process_count = 0;			// worker processes, 0 starts one per hardware thread
+		size_t tiles_per_assignment = 4;	// tiles handed to a worker at a time
+		double tile_timeout = 10.0;			// seconds per tile before an assignment is reissued
+	};
+
+	// Renders a frame in worker processes. The coordinator forks the workers once the Scene is
+	// built, so they share it copy on write, hands them tiles over a socket pair each and copies
+	// the returned pixels into the Image. An assignment not finished within its timeout is handed
+	// to the next idle worker as well and the first result of a tile wins; a worker that dies
+	// has its tiles reissued, and if none is left the coordinator renders the rest itself.
+	//
+	// Messages are plain byte streams (tile indices, then a tile index and its raw pixels per
+	// result), so a worker on another host needs only a connected socket and the same scene.
+	// Workers are forked, which Windows lacks; there render() falls back to a Tile_Renderer
+	// with process_count threads.
+	class Distributed_Renderer {
+	public:
+		Distributed_Renderer() = delete;
+		Distributed_Renderer(const Distributed_Renderer&) = delete;
+		Distributed_Renderer& operator=(const Distributed_Renderer&) = delete;
+		// render_options supplies the tile and packet size; its thread_count is unused
+		Distributed_Renderer(const Render_Options& render_options, const Distributed_Options& options)
+			: render_options_(render_options), options_(options) {
+			if (options_.process_count == 0)
+				options_.process_count = std::max(1u, std::thread::hardware_concurrency());
+			assert(options_.tiles_per_assignment > 0 && options_.tile_timeout > 0.0);
+		}
+
+		const Distributed_Options& options() const { return options_; }
+		size_t process_count() const { return options_.process_count; }
+		// Tiles of the last render handed out again after a timeout or a lost worker
+		size_t reissued_tiles() const { return reissued_tiles_; }
+		size_t lost_workers() const { return lost_workers_; }
+
+#ifdef _WIN32
+		void render(const Scene& scene, Image& image) {
+			Render_Options fallback = render_options_;
+			fallback.thread_count = options_.process_count;
+			Tile_Renderer(fallback).render(scene, image);
+		}
+#else
+		void render(const Scene& scene, Image& image) {
+			static_assert(std::is_trivially_copyable<HDR_rgb>::value, "pixels are sent as raw bytes");
+			std::vector<Tile> tiles = Tile_Renderer::tiles(image.x_resolution(), image.y_resolution(), render_options_.tile_size);
+			reissued_tiles_ = lost_workers_ = 0;
+
+			std::vector<Worker> workers;
+			for (size_t i = 0; i < options_.process_count; ++i) {
+				int sockets[2];
+				if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+					break;
+				pid_t pid = fork();
+				if (pid == 0) {
+					close(sockets[0]);
+					for (const Worker& worker : workers)
+						close(worker.socket);
+					run_worker(sockets[1], scene, image, tiles);
+					_exit(0);
+				}
+				close(sockets[1]);
+				if (pid < 0) {
+					close(sockets[0]);
+					break;
+				}
+				workers.emplace_back(pid, sockets[0]);
+			}
+
+			coordinate(workers, scene, image, tiles);
+
+			// Workers still busy with a timed out assignment are not waited for
+			for (Worker& worker : workers) {
+				if (!worker.assignment.empty())
+					kill(worker.pid, SIGKILL);
+				if (worker.socket >= 0) {
+					uint32_t stop = 0;
+					send_all(worker.socket, &stop, sizeof(stop));
+					close(worker.socket);
+				}
+				waitpid(worker.pid, nullptr, 0);
+			}
+		}
+#endif
+
+	private:
+		using clock = std::chrono::steady_clock;
+
+#ifndef _WIN32
+		struct Worker {
+			Worker(pid_t pid, int socket) : pid(pid), socket(socket) {}
+			pid_t pid;
+			int socket;
+			std::vector<uint32_t> assignment;	// tiles handed out and not yet returned
+			clock::time_point deadline;
+			bool reissued = false;				// the assignment has timed out once already
+		};
+
+		static bool send_all(int socket, const void* data, size_t size) {
+			const char* bytes = static_cast<const char*>(data);
+			while (size > 0) {
+				ssize_t sent = send(socket, bytes, size, MSG_NOSIGNAL);
+				if (sent <= 0)
+					return false;
+				bytes += sent;
+				size -= static_cast<size_t>(sent);
+			}
+			return true;
+		}
+		static bool receive_all(int socket, void* data, size_t size) {
+			char* bytes = static_cast<char*>(data);
+			while (size > 0) {
+				ssize_t received = recv(socket, bytes, size, 0);
+				if (received <= 0)
+					return false;
+				bytes += received;
+				size -= static_cast<size_t>(received);
+			}
+			return true;
+		}
+
+		// Worker loop: an assignment is a tile count and that many tile indices, a count of 0 ends
+		// the worker; each tile is answered by its index and its pixels row by row
+		void run_worker(int socket, const Scene& scene, Image& image, const std::vector<Tile>& tiles) const {
+			std::vector<uint32_t> assignment;
+			std::vector<HDR_rgb> pixels;
+			for (;;) {
+				uint32_t count;
+				if (!receive_all(socket, &count, sizeof(count)) || count == 0)
+					break;
+				assignment.resize(count);
+				if (!receive_all(socket, assignment.data(), count * sizeof(uint32_t)))
+					break;
+				for (uint32_t index : assignment) {
+					const Tile& tile = tiles[index];
+					Tile_Renderer::render_tile(scene, tile, image, render_options_);
+					pixels.clear();
+					for (size_t y = tile.y0; y < tile.y1; ++y)
+						for (size_t x = tile.x0; x < tile.x1; ++x)
+							pixels.push_back(image.pixel(x, y));
+					if (!send_all(socket, &index, sizeof(index)) || !send_all(socket, pixels.data(), pixels.size() * sizeof(HDR_rgb)))
+						return;
+				}
+			}
+			close(socket);
+		}
+
+		void coordinate(std::vector<Worker>& workers, const Scene& scene, Image& image, const std::vector<Tile>& tiles) {
+			std::vector<bool> done(tiles.size(), false);
+			size_t remaining = tiles.size();
+			std::deque<uint32_t> pending;
+			for (uint32_t i = 0; i < tiles.size(); ++i)
+				pending.push_back(i);
+			std::vector<HDR_rgb> pixels;
+			std::vector<pollfd> polled;
+			std::vector<Worker*> polled_workers;
+
+			auto lose = [&](Worker& worker) {
+				++lost_workers_;
+				close(worker.socket);
+				worker.socket = -1;
+				for (uint32_t index : worker.assignment)
+					if (!done[index]) {
+						pending.push_front(index);
+						++reissued_tiles_;
+					}
+				worker.assignment.clear();
+			};
+
+			while (remaining > 0) {
+				// Idle workers get the next pending tiles
+				for (Worker& worker : workers) {
+					if (worker.socket < 0 || !worker.assignment.empty())
+						continue;
+					while (!pending.empty() && worker.assignment.size() < options_.tiles_per_assignment) {
+						if (!done[pending.front()])
+							worker.assignment.push_back(pending.front());
+						pending.pop_front();
+					}
+					if (worker.assignment.empty())
+						continue;
+					uint32_t count = static_cast<uint32_t>(worker.assignment.size());
+					worker.deadline = clock::now() + std::chrono::duration_cast<clock::duration>(
+						std::chrono::duration<double>(options_.tile_timeout * count));
+					worker.reissued = false;
+					if (!send_all(worker.socket, &count, sizeof(count))
+						|| !send_all(worker.socket, worker.assignment.data(), count * sizeof(uint32_t)))
+						lose(worker);
+				}
+
+				polled.clear();
+				polled_workers.clear();
+				clock::time_point wake = clock::time_point::max();
+				for (Worker& worker : workers) {
+					if (worker.socket < 0 || worker.assignment.empty())
+						continue;
+					polled.push_back(pollfd{ worker.socket, POLLIN, 0 });
+					polled_workers.push_back(&worker);
+					if (!worker.reissued)
+						wake = std::min(wake, worker.deadline);
+				}
+				if (polled.empty()) {
+					// No worker left: the coordinator renders what remains
+					for (uint32_t index = 0; index < tiles.size(); ++index)
+						if (!done[index])
+							Tile_Renderer::render_tile(scene, tiles[index], image, render_options_);
+					return;
+				}
+				int timeout = -1;
+				if (wake != clock::time_point::max())
+					timeout = static_cast<int>(std::max<long long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(
+						wake - clock::now()).count() + 1));
+				if (poll(polled.data(), polled.size(), timeout) < 0)
+					continue;
+
+				for (size_t i = 0; i < polled.size(); ++i) {
+					Worker& worker = *polled_workers[i];
+					if (polled[i].revents == 0)
+						continue;
+					uint32_t index;
+					if (!receive_all(worker.socket, &index, sizeof(index))) {
+						lose(worker);
+						continue;
+					}
+					// A tile this worker was not given means it is out of step with the protocol
+					auto assigned = std::find(worker.assignment.begin(), worker.assignment.end(), index);
+					if (assigned == worker.assignment.end()) {
+						lose(worker);
+						continue;
+					}
+					const Tile& tile = tiles[index];
+					pixels.resize(tile.pixel_count());
+					if (!receive_all(worker.socket, pixels.data(), pixels.size() * sizeof(HDR_rgb))) {
+						lose(worker);
+						continue;
+					}
+					worker.assignment.erase(assigned);
+					if (done[index])
+						continue;
+					const HDR_rgb* pixel = pixels.data();
+					for (size_t y = tile.y0; y < tile.y1; ++y)
+						for (size_t x = tile.x0; x < tile.x1; ++x)
+							image.pixel(x, y) = *pixel++;
+					done[index] = true;
+					--remaining;
+				}
+
+				// Assignments past their deadline go to the next idle worker as well
+				clock::time_point now = clock::now();
+				for (Worker& worker : workers) {
+					if (worker.socket < 0 || worker.assignment.empty() || worker.reissued || now < worker.deadline)
+						continue;
+					worker.reissued = true;
+					for (uint32_t index : worker.assignment)
+						if (!done[index]) {
+							pending.push_front(index);
+							++reissued_tiles_;
+						}
+				}
+			}
+		}
+#endif
+
+		Render_Options render_options_;
+		Distributed_Options options_;
+		size_t reissued_tiles_ = 0;
+		size_t lost_workers_ = 0;
+	};
+
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include "Abstract_Shader.h"
 #include "Intersection.h"
 #include "Scene.h"
@@ -11,6 +12,14 @@ namespace RT {
 		HDR_rgb shade(const Scene& scene, const Camera& camera, const Intersection& intersection) const {
 			return intersection.object().color();
 		}
+
+		void shade_batch(const Scene&, const Camera&, const Intersection* intersections, size_t count, HDR_rgb* colors) const {
+			for (size_t first = 0, end; first < count; first = end) {
+				const Abstract_Object& object = intersections[first].object();
+				for (end = first + 1; end < count && &intersections[end].object() == &object; ++end) {}
+				std::fill(colors + first, colors + end, object.color());
+			}
+		}
 	};
 
 }
\ No newline at end of file
@@ -36,7 +36,7 @@ namespace RT {
 	class HDR_rgb {
 	public:
 		enum { R = 0, G = 1, B = 2};
-		using intensity = double;
+		using intensity = real;
 		using storage_type = std::array<intensity, 3>;
 	public:
 		static bool is_valid_intensity(intensity r) { return r <= 1.0 ? true : false; }
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include "Misc.h"
+
+namespace RT {
+
+	class Abstract_Object;
+
+	// What traversal keeps of the closest hit so far. It is cheap to overwrite, unlike an
+	// Intersection, which is only built from the final record by Abstract_Object::make_intersection.
+	// t doubles as the upper bound of the search: only hits closer than t replace the record.
+	struct Hit_Record {
+		real t = REAL_INFINITY;
+		const Abstract_Object* object = nullptr;
+		uint32_t primitive = 0;		// triangle of a mesh, 0 for single primitives
+		float u = 0.0f, v = 0.0f;	// barycentric coordinates of the hit on a triangle
+
+		Hit_Record() = default;
+		explicit Hit_Record(real t_max) : t(t_max) {}
+
+		bool is_hit() const { return object != nullptr; }
+	};
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cassert>
+#include <optional>
+#include "Abstract_Object.h"
+#include "Transform.h"
+#include "HDR_RGB.h"
+
+namespace RT {
+
+	// Another placement of an existing object, typically a Mesh, through an affine transform.
+	// The geometry and its BVH are shared: rays are moved into object space on entry, so a
+	// thousand instances of one mesh cost a thousand transforms, not a thousand meshes. The
+	// object must outlive its instances and is not added to the Scene itself unless it should
+	// also appear untransformed. An instance has its own material.
+	//
+	// Object space rays are normalized again, so their t differs from the world t by the
+	// transformed length of the world direction; hit records carry the world t.
+	class Instance final : public Abstract_Object {
+	public:
+		Instance() = delete;
+		Instance(const Instance&) = default;
+		Instance(const Abstract_Object& object, const Transform& transform)
+			: Instance(object, transform, object.color(), object.shininess()) {}
+		Instance(const Abstract_Object& object, const Transform& transform, const HDR_rgb& color, real shininess)
+			: Abstract_Object(color, shininess), object_(&object), transform_(transform),
+			box_(transform.box(object.bounding_box())) {}
+
+		const Abstract_Object& object() const { return *object_; }
+		const Transform& transform() const { return transform_; }
+
+		virtual Bounding_Box bounding_box() const { return box_; }
+
+		virtual std::optional<Intersection> intersect(const Ray& ray, real t_min, real t_max) const {
+			assert(t_min < t_max);
+			Hit_Record record(t_max);
+			if (!find_hit(ray, t_min, record))
+				return std::nullopt;
+			return make_intersection(ray, record);
+		}
+
+		virtual bool find_hit(const Ray& ray, real t_min, Hit_Record& record) const {
+			real scale;
+			Ray local = object_ray(ray, scale);
+			Hit_Record local_record(record.t * scale);
+			if (!object_->find_hit(local, t_min * scale, local_record))
+				return false;
+			real t = local_record.t / scale;
+			if (!(t < record.t))
+				return false;
+			record = local_record;
+			record.t = t;
+			record.object = this;
+			return true;
+		}
+
+		virtual Intersection make_intersection(const Ray& ray, const Hit_Record& record) const {
+			real scale;
+			Ray local = object_ray(ray, scale);
+			Hit_Record local_record = record;
+			local_record.t = record.t * scale;
+			local_record.object = object_;
+			Intersection hit = object_->make_intersection(local, local_record);
+			return Intersection(this, ray.point_along_ray(record.t), record.t, transform_.normal(hit.normal()));
+		}
+
+		virtual bool occluded(const Ray& ray, real t_min, real t_max) const {
+			real scale;
+			Ray local = object_ray(ray, scale);
+			return object_->occluded(local, t_min * scale, t_max * scale);
+		}
+
+		virtual bool find_occluder(const Ray& ray, real t_min, real t_max, uint32_t& primitive) const {
+			real scale;
+			Ray local = object_ray(ray, scale);
+			return object_->find_occluder(local, t_min * scale, t_max * scale, primitive);
+		}
+
+		virtual bool occluded_by(const Ray& ray, real t_min, real t_max, uint32_t primitive) const {
+			real scale;
+			Ray local = object_ray(ray, scale);
+			return object_->occluded_by(local, t_min * scale, t_max * scale, primitive);
+		}
+
+	private:
+		// ray in object space; scale converts world t to object t
+		Ray object_ray(const Ray& ray, real& scale) const {
+			Direction direction = transform_.inverse_direction(ray.direction());
+			scale = direction.magnitude();
+			return Ray(transform_.inverse_point(ray.origin()), direction);
+		}
+
+		const Abstract_Object* object_;
+		Transform transform_;
+		Bounding_Box box_;
+	};
+
+}
@@ -11,19 +11,19 @@ namespace RT {
 		Light(const Light&) = default;
 		Light(Light&&) = default;
 		Light& operator=(const Light&) = default;
-		Light(const Point& location, const HDR_rgb& color, double intensity)
+		Light(const Point& location, const HDR_rgb& color, real intensity)
 			: location_(location), color_(color), intensity_(intensity) {
 			assert(intensity > 0.0);
 		}
 
 		const Point& location() const { return location_; }
 		const HDR_rgb& color() const { return color_; }
-		double intensity() const { return intensity_; }
+		real intensity() const { return intensity_; }
 
 	private:
 		Point location_;
 		HDR_rgb color_;
-		double intensity_;
+		real intensity_;
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,177 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "Vector.h"
+#include "Bounding_Box.h"
+#include "Light.h"
+#include "Misc.h"
+
+namespace RT {
+
+	// Hierarchy over point lights for scenes with thousands of them. Every node bounds its
+	// lights' positions and keeps their largest and summed intensity, so a whole subtree can be
+	// dismissed when even its strongest light at the nearest corner of the box falls below a
+	// threshold, or picked between in proportion to its estimated contribution.
+	//
+	// A light's contribution at a point is intensity / distance^2, the falloff of a point light.
+	// Shaders that cull or sample by it must scale the light's terms by it too, or the threshold
+	// bounds nothing they compute; see Blinn_Phong_Shader::light_falloff().
+	class Light_BVH {
+	public:
+		static const uint32_t MAX_LEAF_SIZE = 4;
+		static constexpr real MIN_DISTANCE_SQUARED = real(1e-6);
+
+		struct Node {
+			Bounding_Box box;
+			real intensity_sum = 0.0;
+			real max_intensity = 0.0;
+			uint32_t offset = 0;	// first light of a leaf, right child of an interior node
+			uint32_t count = 0;		// lights of a leaf, 0 for interior nodes
+			bool is_leaf() const { return count > 0; }
+		};
+
+	public:
+		Light_BVH() = default;
+
+		void build(const std::vector<Light*>& lights) {
+			nodes_.clear();
+			lights_.assign(lights.begin(), lights.end());
+			if (!lights_.empty())
+				build(0, static_cast<uint32_t>(lights_.size()));
+		}
+
+		size_t size() const { return lights_.size(); }
+		const std::vector<Node>& nodes() const { return nodes_; }
+
+		static real contribution(const Light& light, const Point& p) {
+			return light.intensity() / std::max(MIN_DISTANCE_SQUARED, (light.location() - p).magnitude_squared());
+		}
+
+		// Calls f(light) for every light whose contribution at p reaches threshold
+		template <class F>
+		void for_each_light(const Point& p, real threshold, F f) const {
+			if (nodes_.empty())
+				return;
+			std::array<uint32_t, 64> stack;
+			size_t top = 0;
+			stack[top++] = 0;
+			while (top > 0) {
+				const Node& node = nodes_[stack[--top]];
+				if (node.max_intensity / std::max(MIN_DISTANCE_SQUARED, distance_squared(node.box, p)) < threshold)
+					continue;
+				if (node.is_leaf()) {
+					for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+						if (contribution(*lights_[i], p) >= threshold)
+							f(*lights_[i]);
+				}
+				else {
+					stack[top++] = node.offset;
+					stack[top++] = static_cast<uint32_t>(&node - nodes_.data()) + 1;
+				}
+			}
+		}
+
+		// Picks one light with probability about proportional to its contribution at p, walking
+		// down one path of the tree; u is uniform in [0, 1) and pdf the chosen light's probability
+		const Light* sample(const Point& p, real u, real& pdf) const {
+			pdf = 0.0;
+			if (nodes_.empty())
+				return nullptr;
+			pdf = 1.0;
+			uint32_t index = 0;
+			while (!nodes_[index].is_leaf()) {
+				uint32_t left = index + 1, right = nodes_[index].offset;
+				real left_importance = importance(nodes_[left], p), right_importance = importance(nodes_[right], p);
+				real p_left = (left_importance + right_importance > 0) ? left_importance / (left_importance + right_importance) : real(0.5);
+				if (u < p_left) {
+					index = left;
+					pdf *= p_left;
+					u = u / p_left;
+				}
+				else {
+					index = right;
+					pdf *= 1 - p_left;
+					u = (u - p_left) / (1 - p_left);
+				}
+				u = std::min(u, real(1) - std::numeric_limits<real>::epsilon());
+			}
+			const Node& leaf = nodes_[index];
+			real sum = 0.0;
+			for (uint32_t i = leaf.offset; i < leaf.offset + leaf.count; ++i)
+				sum += contribution(*lights_[i], p);
+			real target = u * sum;
+			uint32_t chosen = leaf.offset + leaf.count - 1;
+			for (uint32_t i = leaf.offset; i < leaf.offset + leaf.count; ++i) {
+				real c = contribution(*lights_[i], p);
+				if (target < c) {
+					chosen = i;
+					break;
+				}
+				target -= c;
+			}
+			pdf *= (sum > 0) ? contribution(*lights_[chosen], p) / sum : real(1) / leaf.count;
+			return lights_[chosen];
+		}
+
+		// Uniform number in [0, 1) that depends only on p and i, so sampling does not depend on
+		// which thread shades a point
+		static real random(const Point& p, uint64_t i) {
+			uint64_t x = fnv1a_hash(&p, sizeof(p)) + 0x9E3779B97F4A7C15ull * (i + 1);
+			x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+			x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+			x ^= x >> 31;
+			return std::min(static_cast<real>((x >> 11) * (1.0 / 9007199254740992.0)), real(1) - std::numeric_limits<real>::epsilon());
+		}
+
+	private:
+		static real distance_squared(const Bounding_Box& box, const Point& p) {
+			real result = 0.0;
+			for (size_t axis = 0; axis < 3; ++axis) {
+				real d = std::max({ real(0), box.min()[axis] - p[axis], p[axis] - box.max()[axis] });
+				result += d * d;
+			}
+			return result;
+		}
+		// Summed intensity over the distance to the box centre, but no closer than half its diagonal
+		static real importance(const Node& node, const Point& p) {
+			real radius_squared = real(0.25) * node.box.extent().magnitude_squared();
+			real d2 = (node.box.centroid() - p).magnitude_squared();
+			return node.intensity_sum / std::max({ MIN_DISTANCE_SQUARED, radius_squared, d2 });
+		}
+
+		// Median split along the widest axis of the light positions
+		uint32_t build(uint32_t first, uint32_t end) {
+			uint32_t index = static_cast<uint32_t>(nodes_.size());
+			nodes_.emplace_back();
+			Node node;
+			for (uint32_t i = first; i < end; ++i) {
+				node.box.expand(lights_[i]->location());
+				node.intensity_sum += lights_[i]->intensity();
+				node.max_intensity = std::max(node.max_intensity, lights_[i]->intensity());
+			}
+			if (end - first <= MAX_LEAF_SIZE) {
+				node.offset = first;
+				node.count = end - first;
+			}
+			else {
+				Direction extent = node.box.extent();
+				size_t axis = (extent[0] > extent[1]) ? ((extent[0] > extent[2]) ? 0 : 2) : ((extent[1] > extent[2]) ? 1 : 2);
+				uint32_t middle = first + (end - first) / 2;
+				std::nth_element(lights_.begin() + first, lights_.begin() + middle, lights_.begin() + end,
+					[axis](const Light* a, const Light* b) { return a->location()[axis] < b->location()[axis]; });
+				build(first, middle);
+				node.offset = build(middle, end);
+			}
+			nodes_[index] = node;
+			return index;
+		}
+
+		std::vector<Node> nodes_;
+		std::vector<const Light*> lights_;
+	};
+
+}
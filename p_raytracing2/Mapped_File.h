@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <utility>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace RT {
+
+	// Read only memory mapping of a whole file. is_open() is false if the file is
+	// missing, empty or cannot be mapped.
+	class Mapped_File {
+	public:
+		Mapped_File() = default;
+		Mapped_File(const Mapped_File&) = delete;
+		Mapped_File& operator=(const Mapped_File&) = delete;
+		Mapped_File(Mapped_File&& file) noexcept { swap(file); }
+		Mapped_File& operator=(Mapped_File&& file) noexcept { swap(file); return *this; }
+		explicit Mapped_File(const std::string& filename) {
+#ifdef _WIN32
+			file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file_ == INVALID_HANDLE_VALUE)
+				return;
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0)
+				return;
+			mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping_ == nullptr)
+				return;
+			void* data = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+			if (data == nullptr)
+				return;
+			data_ = static_cast<const char*>(data);
+			size_ = static_cast<size_t>(size.QuadPart);
+#else
+			int descriptor = open(filename.c_str(), O_RDONLY);
+			if (descriptor < 0)
+				return;
+			struct stat status;
+			if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+				void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+				if (data != MAP_FAILED) {
+					data_ = static_cast<const char*>(data);
+					size_ = static_cast<size_t>(status.st_size);
+				}
+			}
+			close(descriptor);
+#endif
+		}
+		~Mapped_File() {
+#ifdef _WIN32
+			if (data_ != nullptr)
+				UnmapViewOfFile(data_);
+			if (mapping_ != nullptr)
+				CloseHandle(mapping_);
+			if (file_ != INVALID_HANDLE_VALUE)
+				CloseHandle(file_);
+#else
+			if (data_ != nullptr)
+				munmap(const_cast<char*>(data_), size_);
+#endif
+		}
+
+		bool is_open() const { return data_ != nullptr; }
+		const char* data() const { return data_; }
+		size_t size() const { return size_; }
+
+	private:
+		void swap(Mapped_File& file) {
+			std::swap(data_, file.data_);
+			std::swap(size_, file.size_);
+#ifdef _WIN32
+			std::swap(file_, file.file_);
+			std::swap(mapping_, file.mapping_);
+#endif
+		}
+
+		const char* data_ = nullptr;
+		size_t size_ = 0;
+#ifdef _WIN32
+		HANDLE file_ = INVALID_HANDLE_VALUE;
+		HANDLE mapping_ = nullptr;
+#endif
+	};
+
+}
\ No newline at end of file
@@ -1,4 +1,7 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+#include <utility>
 #include "Vector.h"
 #include "Misc.h"
 
@@ -74,13 +77,20 @@ namespace RT {
 		// Matrix-matrix multiplication
 		template <size_t RESULT_WIDTH>
 		Matrix<scalar_type, HEIGHT, RESULT_WIDTH> operator*(const Matrix<scalar_type, WIDTH, RESULT_WIDTH>& rhs) const {
-			Matrix < scalar_type, HEIGHT< RESULT_WIDTH> result_;
+			Matrix<scalar_type, HEIGHT, RESULT_WIDTH> result_;
 			for (size_t y = 0; y < HEIGHT; ++y) // rows
 				for (size_t x = 0; x < RESULT_WIDTH; ++x) // result-width
 					for (size_t addies = 0; addies < WIDTH; ++addies) // column
 						result_[y][x] += data_[y][addies] * rhs[addies][x];
 			return result_;
 		}
+		// Matrix-vector multiplication
+		Vector<scalar_type, HEIGHT> operator*(const Vector<scalar_type, WIDTH>& vec) const {
+			Vector<scalar_type, HEIGHT> result_;
+			for (size_t y = 0; y < HEIGHT; ++y)
+				result_[y] = data_[y] * vec;
+			return result_;
+		}
 		same_type operator/(scalar_type scalar) const {
 			same_type quotient_;
 			for (size_t y = 0; y < HEIGHT; ++y)
@@ -151,6 +161,33 @@ namespace RT {
 
 		}
 
+		// Inverse by Gauss-Jordan elimination with partial pivoting, for any size of square matrix
+		same_type inverse() const {
+			static_assert(WIDTH == HEIGHT, "Matrix must be square to invert");
+			same_type work_(*this);
+			same_type inverse_ = identity();
+			for (size_t x = 0; x < WIDTH; ++x) {
+				size_t pivot = x;
+				for (size_t y = x + 1; y < HEIGHT; ++y)
+					if (std::abs(work_[y][x]) > std::abs(work_[pivot][x]))
+						pivot = y;
+				assert(work_[pivot][x] != scalar_type(0));
+				std::swap(work_[x], work_[pivot]);
+				std::swap(inverse_[x], inverse_[pivot]);
+				scalar_type scale = work_[x][x];
+				work_[x] = work_[x] / scale;
+				inverse_[x] = inverse_[x] / scale;
+				for (size_t y = 0; y < HEIGHT; ++y) {
+					if (y == x || work_[y][x] == scalar_type(0))
+						continue;
+					scalar_type factor = work_[y][x];
+					work_[y] = work_[y] - work_[x] * factor;
+					inverse_[y] = inverse_[y] - inverse_[x] * factor;
+				}
+			}
+			return inverse_;
+		}
+
 		// Converting to other types
 
 
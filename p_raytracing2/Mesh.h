@@ -1,55 +1,247 @@
 #pragma once
+#include <algorithm>
+#include <array>
 #include <fstream>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
+#include "Abstract_Object.h"
 #include "Triangle_Object.h"
+#include "Triangle_SoA.h"
 #include "HDR_RGB.h"
+#include "BVH.h"
+#include "Mesh_Cache.h"
 #include "OBJ_Loader.h"
 
 namespace RT {
 
-	class Mesh {
+	// A triangle mesh is a single object to the Scene. It owns the bottom level BVH over
+	// its triangles, so the scene level BVH only has to bound the mesh as a whole.
+	// With use_cache the geometry and BVH are kept in filename + ".bvhcache" and
+	// reused as long as the OBJ and the build options stay the same.
+	//
+	// Geometry is one shared vertex buffer and three 32-bit indices per triangle, with the
+	// triangles stored in BVH leaf order. Intersection runs on a Triangle_SoA copy.
+	class Mesh final : public Abstract_Object {
 	public:
-		using storage_type = std::vector<Triangle_Object*>;
-		using iterator = storage_type::iterator;
-		using const_iterator = storage_type::const_iterator;
+		using vertex_storage_type = std::vector<Point>;
+		using index_storage_type = std::vector<uint32_t>;
 	public:
 		Mesh() = delete;
 		Mesh(const Mesh&) = delete;
 		Mesh& operator=(const Mesh&) = delete;
-		Mesh(std::string filename, const HDR_rgb& color = HDR_rgb(), double shininess = 0.1) {
+		Mesh(std::string filename, const HDR_rgb& color = HDR_rgb(), real shininess = 0.1,
+			const BVH_Build_Options& options = BVH_Build_Options(), bool use_cache = true)
+			: Abstract_Object(color, shininess) {
+			loaded_from_cache_ = load_geometry(filename, options, use_cache, vertices_, indices_, bvh_);
+			triangles_.assign(vertices_, indices_);
+		}
+
+		// Everything of a Mesh but its Triangle_SoA: the vertices, the indices in BVH leaf order and
+		// the BVH, from the cache if it is still valid. Returns whether the cache was used.
+		static bool load_geometry(const std::string& filename, const BVH_Build_Options& options, bool use_cache,
+			vertex_storage_type& vertices, index_storage_type& indices, BVH& bvh) {
+			std::string cache_filename = filename + ".bvhcache";
+			uint64_t key = use_cache ? mesh_cache_key(filename, options) : 0;
+			BVH::node_storage_type nodes;
+			if (read_mesh_cache(cache_filename, key, vertices, indices, nodes)) {
+				index_storage_type order(indices.size() / 3);
+				for (size_t i = 0; i < order.size(); ++i)
+					order[i] = static_cast<uint32_t>(i);
+				bvh.restore(std::move(nodes), std::move(order), options.layout);
+				return true;
+			}
+			load_obj(filename, vertices, indices);
+			build_bvh(options, vertices, indices, bvh);
+			write_mesh_cache(cache_filename, key, vertices, indices, bvh);
+			return false;
+		}
+
+		size_t size() const { return indices_.size() / 3; }
+		bool is_empty() const { return indices_.empty(); }
+		const vertex_storage_type& vertices() const { return vertices_; }
+		const index_storage_type& indices() const { return indices_; }
+		const Point& vertex(size_t triangle, size_t corner) const { return vertices_[indices_[3 * triangle + corner]]; }
+		Triangle_Object triangle(size_t i) const {
+			assert(i < size());
+			return Triangle_Object(vertex(i, 0), vertex(i, 1), vertex(i, 2), color(), shininess());
+		}
+		size_t memory_bytes() const {
+			return vertices_.size() * sizeof(Point) + indices_.size() * sizeof(uint32_t) + triangles_.memory_bytes()
+				+ bvh_.nodes().size() * sizeof(BVH::Node) + bvh_.primitive_indices().size() * sizeof(uint32_t);
+		}
+		const BVH& bvh() const { return bvh_; }
+		bool loaded_from_cache() const { return loaded_from_cache_; }
+		void bvh_layout(BVH_Layout layout) { bvh_.layout(layout); }
+
+		virtual Bounding_Box bounding_box() const { return bvh_.bounding_box(); }
+
+		virtual std::optional<Intersection> intersect(const Ray& ray, real t_min, real t_max) const {
+			assert(t_min < t_max);
+			Hit_Record record(t_max);
+			if (!find_hit(ray, t_min, record))
+				return std::nullopt;
+			return make_intersection(ray, record);
+		}
+
+		// Candidate triangles only update the closest t; the barycentrics are worked out once
+		// for the triangle that wins
+		virtual bool find_hit(const Ray& ray, real t_min, Hit_Record& record) const {
+			Triangle_SoA::Ray_Data ray_data(ray);
+			uint32_t best = Triangle_SoA::NO_HIT;
+			real t_max = record.t;
+			bvh_.traverse_leaves(ray, t_min, t_max, [&](uint32_t first, uint32_t count, real& t_max) {
+				float t = static_cast<float>(t_max);
+				uint32_t hit = triangles_.closest_hit(ray_data, first, count, static_cast<float>(t_min), t);
+				if (hit != Triangle_SoA::NO_HIT && t < t_max) {
+					best = hit;
+					t_max = t;
+				}
+			});
+			if (best == Triangle_SoA::NO_HIT)
+				return false;
+			record = Hit_Record(t_max);
+			record.object = this;
+			record.primitive = best;
+			triangles_.barycentrics(ray_data, best, record.u, record.v);
+			return true;
+		}
+
+		virtual Intersection make_intersection(const Ray& ray, const Hit_Record& record) const {
+			return Intersection(this, ray.point_along_ray(record.t), record.t, triangle_normal(record.primitive));
+		}
+
+		virtual bool occluded(const Ray& ray, real t_min, real t_max) const {
+			uint32_t primitive;
+			return find_occluder(ray, t_min, t_max, primitive);
+		}
+
+		virtual bool find_occluder(const Ray& ray, real t_min, real t_max, uint32_t& primitive) const {
+			Triangle_SoA::Ray_Data ray_data(ray);
+			return bvh_.occluded_leaves(ray, t_min, t_max, [&](uint32_t first, uint32_t count) {
+				uint32_t hit = triangles_.first_hit(ray_data, first, count, static_cast<float>(t_min), static_cast<float>(t_max));
+				if (hit == Triangle_SoA::NO_HIT)
+					return false;
+				primitive = hit;
+				return true;
+			});
+		}
+
+		virtual bool occluded_by(const Ray& ray, real t_min, real t_max, uint32_t primitive) const {
+			assert(primitive < size());
+			return triangles_.any_hit(Triangle_SoA::Ray_Data(ray), primitive, 1, static_cast<float>(t_min), static_cast<float>(t_max));
+		}
+
+		virtual void find_hits(Ray_Packet& packet, real t_min, uint64_t active, Hit_Record* records) const {
+			if (!packet.is_coherent())
+				return Abstract_Object::find_hits(packet, t_min, active, records);
+			std::array<Triangle_SoA::Ray_Data, Ray_Packet::MAX_SIZE> ray_data;
+			std::array<uint32_t, Ray_Packet::MAX_SIZE> best;
+			for (uint64_t mask = active; mask != 0; mask &= mask - 1) {
+				size_t i = lowest_bit(mask);
+				ray_data[i] = Triangle_SoA::Ray_Data(packet.ray(i));
+				best[i] = Triangle_SoA::NO_HIT;
+			}
+			bvh_.traverse_leaves(packet, t_min, active, [&](uint32_t first, uint32_t count, uint64_t mask) {
+				for (; mask != 0; mask &= mask - 1) {
+					size_t i = lowest_bit(mask);
+					float t = static_cast<float>(packet.t_max(i));
+					uint32_t hit = triangles_.closest_hit(ray_data[i], first, count, static_cast<float>(t_min), t);
+					if (hit != Triangle_SoA::NO_HIT && t < packet.t_max(i)) {
+						best[i] = hit;
+						packet.t_max(i, t);
+					}
+				}
+			});
+			for (; active != 0; active &= active - 1) {
+				size_t i = lowest_bit(active);
+				if (best[i] == Triangle_SoA::NO_HIT)
+					continue;
+				records[i] = Hit_Record(packet.t_max(i));
+				records[i].object = this;
+				records[i].primitive = best[i];
+				triangles_.barycentrics(ray_data[i], best[i], records[i].u, records[i].v);
+			}
+		}
+
+	private:
+		Direction triangle_normal(size_t i) const {
+			return (vertex(i, 1) - vertex(i, 0)).cross(vertex(i, 2) - vertex(i, 0)).normalized();
+		}
+
+		// Corners of different faces that share a position share one vertex
+		static void load_obj(const std::string& filename, vertex_storage_type& vertices, index_storage_type& indices) {
+			struct Point_Hash {
+				size_t operator()(const Point& p) const { return static_cast<size_t>(fnv1a_hash(&p, sizeof(p))); }
+			};
 			objl::Loader loader;
 			bool loadout = loader.LoadFile(filename);
 			assert(loadout);
+			std::unordered_map<Point, uint32_t, Point_Hash> lookup;
 			for (size_t i = 0; i < loader.LoadedMeshes.size(); ++i) {
-				objl::Mesh mesh = loader.LoadedMeshes[i];
-				for (size_t j = 0; j < mesh.Indices.size(); j+=3) {
-					triangles_.push_back(new Triangle_Object(
-						Point({ mesh.Vertices[mesh.Indices[j]].Position.X,   mesh.Vertices[mesh.Indices[j]].Position.Y,   mesh.Vertices[mesh.Indices[j]].Position.Z }),
-						Point({ mesh.Vertices[mesh.Indices[j+1]].Position.X, mesh.Vertices[mesh.Indices[j+1]].Position.Y, mesh.Vertices[mesh.Indices[j+1]].Position.Z }),
-						Point({ mesh.Vertices[mesh.Indices[j+2]].Position.X, mesh.Vertices[mesh.Indices[j+2]].Position.Y, mesh.Vertices[mesh.Indices[j+2]].Position.Z }), 
-						color, shininess));
+				const objl::Mesh& mesh = loader.LoadedMeshes[i];
+				for (size_t j = 0; j < mesh.Indices.size(); ++j) {
+					const objl::Vector3& position = mesh.Vertices[mesh.Indices[j]].Position;
+					// + 0.0f turns -0.0 into 0.0, which compare equal and must hash equal
+					Point point({ real(position.X + 0.0f), real(position.Y + 0.0f), real(position.Z + 0.0f) });
+					auto found = lookup.emplace(point, static_cast<uint32_t>(vertices.size()));
+					if (found.second)
+						vertices.push_back(point);
+					indices.push_back(found.first->second);
 				}
 			}
+			indices.resize(indices.size() / 3 * 3);
 		}
-		~Mesh() {
-			for (size_t i = 0; i < triangles_.size(); ++i) {
-				delete triangles_[i];
+
+		// Builds the BVH and reorders the triangles so every leaf covers consecutive ones
+		static void build_bvh(const BVH_Build_Options& options, const vertex_storage_type& vertices, index_storage_type& indices, BVH& bvh) {
+			std::vector<Bounding_Box> boxes(indices.size() / 3);
+			for (size_t i = 0; i < boxes.size(); ++i) {
+				boxes[i] = Bounding_Box(vertices[indices[3 * i]]);
+				boxes[i].expand(vertices[indices[3 * i + 1]]);
+				boxes[i].expand(vertices[indices[3 * i + 2]]);
 			}
+			bvh.build(boxes, options);
+			index_storage_type order = bvh.take_primitive_order();
+			index_storage_type reordered(indices.size());
+			for (size_t i = 0; i < order.size(); ++i)
+				for (size_t corner = 0; corner < 3; ++corner)
+					reordered[3 * i + corner] = indices[3 * order[i] + corner];
+			indices = std::move(reordered);
 		}
 
+		vertex_storage_type vertices_;
+		index_storage_type indices_;
+		Triangle_SoA triangles_;
+		BVH bvh_;
+		bool loaded_from_cache_ = false;
+	};
 
-		iterator begin() { return triangles_.begin(); }
-		iterator end() { return triangles_.end(); }
-		const_iterator begin() const { return triangles_.begin(); }
-		const_iterator end() const { return triangles_.end(); }
-		size_t size() const { return triangles_.size(); }
-		bool is_empty() const { return triangles_.empty(); }
-		const Triangle_Object& operator[](size_t i) const { assert(i < triangles_.size()); return *triangles_[i]; }
-		Triangle_Object& operator[](size_t i) { assert(i < triangles_.size()); return *triangles_[i]; }
-
-
-	private:
-		storage_type triangles_;
+	struct Mesh_Source {
+		std::string filename;
+		HDR_rgb color;
+		real shininess = 0.1;
 	};
 
+	// Loads each mesh on a thread of its own, so parsing and BVH building of independent meshes
+	// overlap instead of adding up. The builds share the options' thread_count between them
+	// rather than each starting as many. The meshes come back in the order of sources.
+	inline std::vector<std::unique_ptr<Mesh>> load_meshes(const std::vector<Mesh_Source>& sources,
+		const BVH_Build_Options& options = BVH_Build_Options()) {
+		BVH_Build_Options each = options;
+		if (!sources.empty())
+			each.thread_count = std::max<size_t>(1, options.thread_count / sources.size());
+		std::vector<std::future<std::unique_ptr<Mesh>>> loading;
+		for (const Mesh_Source& source : sources)
+			loading.push_back(std::async(std::launch::async, [&source, &each]() {
+				return std::make_unique<Mesh>(source.filename, source.color, source.shininess, each);
+			}));
+		std::vector<std::unique_ptr<Mesh>> meshes;
+		for (auto& mesh : loading)
+			meshes.push_back(mesh.get());
+		return meshes;
+	}
+
 }
\ No newline at end of file
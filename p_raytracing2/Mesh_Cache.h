@@ -0,0 +1,189 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Misc.h"
+#include "BVH.h"
+#include "Mapped_File.h"
+
+namespace RT {
+
+	// Binary cache of a mesh's vertices, indices and BVH, so an unchanged OBJ is neither
+	// parsed nor indexed again. The file is memory mapped on load and only trusted if its magic,
+	// version and key match; the key hashes the OBJ contents and the build parameters
+	// that shape the tree.
+	//
+	// Layout: Mesh_Cache_Header, then vertex_count * 3 reals, index_count uint32_t
+	// vertex indices (three per triangle, in BVH leaf order) and node_count Mesh_Cache_Node
+	// records. The BVH's primitive order is the identity and not stored.
+	const uint32_t MESH_CACHE_VERSION = 3;
+	const char MESH_CACHE_MAGIC[8] = { 'R', 'T', 'M', 'E', 'S', 'H', 'C', '\0' };
+
+	struct Mesh_Cache_Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t endian_check;
+		uint64_t key;
+		uint64_t vertex_count;
+		uint64_t index_count;
+		uint64_t node_count;
+	};
+
+	struct Mesh_Cache_Node {
+		real min[3];
+		real max[3];
+		uint32_t offset, count, axis, padding;
+	};
+
+	// Returns 0 if the OBJ cannot be read, which never matches a written cache
+	inline uint64_t mesh_cache_key(const std::string& obj_filename, const BVH_Build_Options& options) {
+		Mapped_File obj(obj_filename);
+		if (!obj.is_open())
+			return 0;
+		uint64_t hash = fnv1a_hash(obj.data(), obj.size());
+		uint64_t parameters[5] = { MESH_CACHE_VERSION, sizeof(real), options.bin_count, options.max_leaf_size, options.leaf_batch_size };
+		hash = fnv1a_hash(parameters, sizeof(parameters), hash);
+		return (hash == 0) ? 1 : hash;
+	}
+
+	// Whether indices and nodes only refer to what is there, so a corrupt file with a matching
+	// key cannot make traversal read out of bounds: whole triangles of existing vertices, leaves
+	// within the triangles, and a tree in which every node but the root has exactly one parent
+	// that precedes it, no deeper than the traversal stacks.
+	inline bool valid_mesh_cache(const std::vector<Point>& vertices, const std::vector<uint32_t>& indices, const BVH::node_storage_type& nodes) {
+		if (indices.size() % 3 != 0)
+			return false;
+		for (uint32_t index : indices)
+			if (index >= vertices.size())
+				return false;
+		size_t triangle_count = indices.size() / 3;
+		if (nodes.empty())
+			return triangle_count == 0;
+		std::vector<uint32_t> parents(nodes.size(), 0), depth(nodes.size(), 1);
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			const BVH::Node& node = nodes[i];
+			if (node.is_leaf()) {
+				if (node.offset > triangle_count || node.count > triangle_count - node.offset)
+					return false;
+				continue;
+			}
+			if (node.axis >= 3 || node.offset <= i + 1 || node.offset >= nodes.size())
+				return false;
+			for (size_t child : { i + 1, size_t(node.offset) }) {
+				if (++parents[child] > 1)
+					return false;
+				depth[child] = depth[i] + 1;
+				if (depth[child] > BVH::STACK_SIZE)
+					return false;
+			}
+		}
+		for (size_t i = 1; i < nodes.size(); ++i)
+			if (parents[i] != 1)
+				return false;
+		return true;
+	}
+
+	inline bool read_mesh_cache(const std::string& filename, uint64_t key, std::vector<Point>& vertices,
+		std::vector<uint32_t>& indices, BVH::node_storage_type& nodes) {
+		if (key == 0)
+			return false;
+		Mapped_File file(filename);
+		if (!file.is_open() || file.size() < sizeof(Mesh_Cache_Header))
+			return false;
+		Mesh_Cache_Header header;
+		std::memcpy(&header, file.data(), sizeof(header));
+		if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != MESH_CACHE_VERSION
+			|| header.endian_check != 0x01020304 || header.key != key)
+			return false;
+		// Bounded first, so the byte counts below cannot overflow
+		if (header.vertex_count > file.size() / sizeof(Point) || header.index_count > file.size() / sizeof(uint32_t)
+			|| header.node_count > file.size() / sizeof(Mesh_Cache_Node))
+			return false;
+		size_t vertex_bytes = header.vertex_count * sizeof(Point);
+		size_t index_bytes = header.index_count * sizeof(uint32_t);
+		size_t node_bytes = header.node_count * sizeof(Mesh_Cache_Node);
+		if (file.size() != sizeof(header) + vertex_bytes + index_bytes + node_bytes)
+			return false;
+
+		// Decoded aside, the outputs are left alone unless the whole cache is valid
+		const char* data = file.data() + sizeof(header);
+		std::vector<Point> cached_vertices(header.vertex_count);
+		std::memcpy(cached_vertices.data(), data, vertex_bytes);
+		data += vertex_bytes;
+		std::vector<uint32_t> cached_indices(header.index_count);
+		std::memcpy(cached_indices.data(), data, index_bytes);
+		data += index_bytes;
+		BVH::node_storage_type cached_nodes(header.node_count);
+		for (size_t i = 0; i < header.node_count; ++i, data += sizeof(Mesh_Cache_Node)) {
+			Mesh_Cache_Node node;
+			std::memcpy(&node, data, sizeof(node));
+			cached_nodes[i] = BVH::Node{ Bounding_Box(Point({ node.min[0], node.min[1], node.min[2] }), Point({ node.max[0], node.max[1], node.max[2] })),
+				node.offset, node.count, node.axis };
+		}
+		if (!valid_mesh_cache(cached_vertices, cached_indices, cached_nodes))
+			return false;
+		vertices = std::move(cached_vertices);
+		indices = std::move(cached_indices);
+		nodes = std::move(cached_nodes);
+		return true;
+	}
+
+	// Distinct for every call in every process, so concurrent writers of one cache, such as two
+	// threads loading the same OBJ, never write the same temporary file
+	inline std::string mesh_cache_temporary(const std::string& filename) {
+		static std::atomic<uint64_t> writes{ 0 };
+#ifdef _WIN32
+		unsigned long process = GetCurrentProcessId();
+#else
+		long process = static_cast<long>(getpid());
+#endif
+		return filename + ".tmp." + std::to_string(process) + "." + std::to_string(++writes);
+	}
+
+	// Writes to a temporary file first, so a crash never leaves a truncated cache behind
+	inline bool write_mesh_cache(const std::string& filename, uint64_t key, const std::vector<Point>& vertices,
+		const std::vector<uint32_t>& indices, const BVH& bvh) {
+		static_assert(sizeof(Point) == 3 * sizeof(real), "Point must be tightly packed");
+		if (key == 0)
+			return false;
+		std::string temporary = mesh_cache_temporary(filename);
+		bool written;
+		{
+			std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+			if (!out)
+				return false;
+			Mesh_Cache_Header header;
+			std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+			header.version = MESH_CACHE_VERSION;
+			header.endian_check = 0x01020304;
+			header.key = key;
+			header.vertex_count = vertices.size();
+			header.index_count = indices.size();
+			header.node_count = bvh.nodes().size();
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(Point));
+			out.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint32_t));
+			for (const BVH::Node& node : bvh.nodes()) {
+				Mesh_Cache_Node record = { { node.box.min()[0], node.box.min()[1], node.box.min()[2] },
+					{ node.box.max()[0], node.box.max()[1], node.box.max()[2] }, node.offset, node.count, node.axis, 0 };
+				out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+			}
+			written = static_cast<bool>(out);
+		}
+		if (written) {
+#ifdef _WIN32
+			// Only POSIX rename() replaces an existing file, atomically
+			std::remove(filename.c_str());
+#endif
+			written = std::rename(temporary.c_str(), filename.c_str()) == 0;
+		}
+		if (!written)
+			std::remove(temporary.c_str());
+		return written;
+	}
+
+}
\ No newline at end of file
@@ -2,12 +2,27 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <limits>
 
 namespace RT {
 
+	// Scalar type of the render pipeline: scene geometry, rays, hits, shading and colors. Define
+	// RT_SINGLE_PRECISION for a float build, which fits twice the values in a SIMD register and
+	// halves the memory traffic. Meshes, quantized meshes and sphere sets intersect on float
+	// copies (Triangle_SoA, Sphere_SoA) in either build, so the double build only adds accuracy
+	// to the single spheres and triangles, the top level BVH and shading.
+#if defined(RT_SINGLE_PRECISION)
+	using real = float;
+#else
+	using real = double;
+#endif
+
 	const double DOUBLE_INFINITY = std::numeric_limits<double>::infinity();
 	const double DOUBLE_NEGATIVE_INFINITY = -DOUBLE_INFINITY;
+	const real REAL_INFINITY = std::numeric_limits<real>::infinity();
+	const real REAL_NEGATIVE_INFINITY = -REAL_INFINITY;
 
 	template <typename number_type>
 	bool approx_equal(number_type a, number_type b, number_type delta) {
@@ -20,4 +35,14 @@ namespace RT {
 
 	}
 
+	// 64-bit FNV-1a over raw bytes; chain calls by passing the previous hash
+	inline uint64_t fnv1a_hash(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
 }
\ No newline at end of file
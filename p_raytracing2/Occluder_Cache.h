@@ -0,0 +1,109 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <unordered_map>
+#include "Ray.h"
+#include "Hit_Record.h"
+#include "Light.h"
+#include "Scene.h"
+
+namespace RT {
+
+	struct Occluder_Cache_Statistics {
+		uint64_t queries = 0;	// shadow rays asked about
+		uint64_t hits = 0;		// rays blocked by the cached occluder, no traversal
+		uint64_t misses = 0;	// rays the cached occluder did not block, traversed
+
+		double hit_rate() const { return (queries > 0) ? double(hits) / queries : 0.0; }
+
+		friend std::ostream& operator<<(std::ostream& out, const Occluder_Cache_Statistics& statistics) {
+			return out << statistics.queries << " shadow rays, " << 100.0 * statistics.hit_rate() << "% blocked by the cached occluder, "
+				<< statistics.misses << " cached occluders missed";
+		}
+	};
+
+	// Last occluder of every light, one cache per thread. Neighbouring shading points of one
+	// thread mostly see a light blocked by the same triangle, so that primitive is tested alone
+	// before the shadow ray traverses the scene, and a hit skips the traversal. The answer is
+	// exactly that of Scene::occluded. The cache empties itself when it is used with another
+	// scene or after the scene is rebuilt.
+	class Occluder_Cache {
+	public:
+		Occluder_Cache(const Occluder_Cache&) = delete;
+		Occluder_Cache& operator=(const Occluder_Cache&) = delete;
+
+		// The calling thread's cache
+		static Occluder_Cache& local() {
+			thread_local Occluder_Cache cache;
+			return cache;
+		}
+
+		bool occluded(const Scene& scene, const Light& light, const Ray& ray, real t_min, real t_max) {
+			if (scene_build_ != scene.build_id()) {
+				occluders_.clear();
+				scene_build_ = scene.build_id();
+			}
+			count(queries_);
+			auto cached = occluders_.find(&light);
+			if (cached != occluders_.end()) {
+				if (cached->second.object->occluded_by(ray, t_min, t_max, cached->second.primitive)) {
+					count(hits_);
+					return true;
+				}
+				count(misses_);
+			}
+			Hit_Record occluder;
+			if (!scene.find_occluder(ray, t_min, t_max, occluder))
+				return false;
+			occluders_[&light] = occluder;
+			return true;
+		}
+
+		void clear() { occluders_.clear(); }
+
+		// Summed over the caches of all threads, including those that have exited
+		static Occluder_Cache_Statistics statistics() {
+			std::lock_guard<std::mutex> lock(registry_mutex());
+			Occluder_Cache_Statistics result = retired();
+			for (const Occluder_Cache* cache : registry())
+				cache->add_to(result);
+			return result;
+		}
+
+	private:
+		Occluder_Cache() {
+			std::lock_guard<std::mutex> lock(registry_mutex());
+			registry().insert(this);
+		}
+		~Occluder_Cache() {
+			std::lock_guard<std::mutex> lock(registry_mutex());
+			add_to(retired());
+			registry().erase(this);
+		}
+
+		// Counters have one writer, statistics() may read them from any thread
+		static void count(std::atomic<uint64_t>& counter) {
+			counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+		void add_to(Occluder_Cache_Statistics& statistics) const {
+			statistics.queries += queries_.load(std::memory_order_relaxed);
+			statistics.hits += hits_.load(std::memory_order_relaxed);
+			statistics.misses += misses_.load(std::memory_order_relaxed);
+		}
+
+		static std::mutex& registry_mutex() { static std::mutex mutex; return mutex; }
+		static std::set<const Occluder_Cache*>& registry() { static std::set<const Occluder_Cache*> caches; return caches; }
+		static Occluder_Cache_Statistics& retired() { static Occluder_Cache_Statistics statistics; return statistics; }
+
+		uint64_t scene_build_ = 0;
+		std::unordered_map<const Light*, Hit_Record> occluders_;
+		std::atomic<uint64_t> queries_{ 0 };
+		std::atomic<uint64_t> hits_{ 0 };
+		std::atomic<uint64_t> misses_{ 0 };
+	};
+
+}
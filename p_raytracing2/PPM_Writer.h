@@ -1,6 +1,12 @@
 #pragma once
 #include "Image.h"
+#include <algorithm>
+#include <cassert>
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace RT {
 
@@ -13,4 +19,76 @@ namespace RT {
 		outfile.close();
 	}
 
-}
\ No newline at end of file
+	// Writes the same file as ppm_writer while the image is still being rendered. The image is
+	// cut into bands of band_height rows; a renderer reports finished pixels per band, the
+	// thread completing a band encodes it, and bands are written in file order (top row first)
+	// as soon as all bands above them are written. Thread safe.
+	class PPM_Stream_Writer {
+	public:
+		PPM_Stream_Writer() = delete;
+		PPM_Stream_Writer(const PPM_Stream_Writer&) = delete;
+		PPM_Stream_Writer& operator=(const PPM_Stream_Writer&) = delete;
+		PPM_Stream_Writer(const Image& image, const std::string& title, size_t band_height)
+			: image_(image), band_height_(band_height), outfile_(title),
+			band_count_((image.y_resolution() + band_height - 1) / band_height), pixels_left_(band_count_),
+			next_band_(band_count_) {
+			assert(band_height_ > 0);
+			for (size_t band = 0; band < band_count_; ++band)
+				pixels_left_[band] = image_.x_resolution() * (std::min(image_.y_resolution(), (band + 1) * band_height_) - band * band_height_);
+			outfile_ << "P3" << '\n' << image_.x_resolution() << ' ' << image_.y_resolution() << ' ' << "255" << '\n';
+		}
+
+		// count more pixels of the band holding row y are final
+		void pixels_done(size_t y, size_t count) {
+			size_t band = y / band_height_;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				assert(pixels_left_[band] >= count);
+				pixels_left_[band] -= count;
+				if (pixels_left_[band] > 0)
+					return;
+			}
+			std::string text = encode(band);
+			std::lock_guard<std::mutex> lock(mutex_);
+			encoded_[band] = std::move(text);
+			// Bands are numbered bottom up, the file starts with the top one
+			for (auto next = encoded_.find(next_band_ - 1); next != encoded_.end(); next = encoded_.find(next_band_ - 1)) {
+				outfile_ << next->second;
+				encoded_.erase(next);
+				--next_band_;
+			}
+		}
+
+		bool complete() const { std::lock_guard<std::mutex> lock(mutex_); return next_band_ == 0; }
+		// Closes the file, false if it is incomplete or could not be written
+		bool close() {
+			std::lock_guard<std::mutex> lock(mutex_);
+			outfile_.close();
+			return next_band_ == 0 && !outfile_.fail();
+		}
+
+	private:
+		std::string encode(size_t band) const {
+			size_t y0 = band * band_height_, y1 = std::min(image_.y_resolution(), y0 + band_height_);
+			std::string text;
+			text.reserve((y1 - y0) * image_.x_resolution() * 12);
+			for (size_t y = y1; y-- > y0;) {
+				for (size_t x = 0; x < image_.x_resolution(); ++x) {
+					RGB_888 color = image_.pixel(x, y).rgb_888();
+					text += std::to_string(color.r()) + ' ' + std::to_string(color.g()) + ' ' + std::to_string(color.b()) + '\n';
+				}
+			}
+			return text;
+		}
+
+		const Image& image_;
+		size_t band_height_;
+		std::ofstream outfile_;
+		size_t band_count_;
+		mutable std::mutex mutex_;
+		std::vector<size_t> pixels_left_;
+		std::map<size_t, std::string> encoded_;		// encoded bands waiting for the bands above them
+		size_t next_band_;							// bands below this one are still to be written
+	};
+
+}
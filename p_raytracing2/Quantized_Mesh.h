@@ -0,0 +1,300 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include "Abstract_Object.h"
+#include "Triangle_SoA.h"
+#include "Mesh.h"
+#include "BVH.h"
+
+namespace RT {
+
+	// Bits per vertex coordinate of a Quantized_Mesh
+	enum class Vertex_Quantization { BITS_16, BITS_21 };
+
+	inline std::ostream& operator<<(std::ostream& out, Vertex_Quantization quantization) {
+		return out << ((quantization == Vertex_Quantization::BITS_21) ? "21 bit" : "16 bit");
+	}
+
+	// Read only copy of a Mesh with quantized vertex positions, for meshes too large to keep in
+	// full precision. The triangles keep the Mesh's BVH leaf order and are grouped in blocks of
+	// BLOCK_SIZE; every corner is stored as fixed point offsets from the origin of its block.
+	// 16 bits per coordinate take 18 bytes per triangle, 21 bits pack a corner into one
+	// 64-bit word for 24 bytes per triangle, where a Mesh takes about 60 (vertices, indices and
+	// Triangle_SoA). Each visited leaf is decoded into float lanes and tested by the
+	// Triangle_SoA kernels.
+	//
+	// All blocks quantize to one grid per axis: the step is a power of two that fits the widest
+	// block into 2^bits - 3 steps, and no finer than the float spacing of the mesh's largest
+	// coordinate. Block origins lie on the grid, so origin + offset * step is exact in float up
+	// to the final rounding of the sum, and a vertex shared by triangles of different blocks
+	// decodes to the same point in each. Quantizing adds no cracks between blocks.
+	//
+	// Error bound: every decoded coordinate lies within half a step of the original, plus the
+	// float rounding of the decode. max_error() is the largest half step over the axes. A single
+	// block much larger than the others coarsens the grid of the whole mesh. The BVH is refit to
+	// the decoded triangles, so its boxes bound exactly what is intersected.
+	class Quantized_Mesh final : public Abstract_Object {
+	public:
+		static constexpr size_t BLOCK_SIZE = 8;		// triangles sharing one quantization origin
+		static constexpr uint32_t NO_HIT = Triangle_SoA::NO_HIT;
+
+	public:
+		Quantized_Mesh() = delete;
+		Quantized_Mesh(const Quantized_Mesh&) = delete;
+		Quantized_Mesh& operator=(const Quantized_Mesh&) = delete;
+		// The mesh can be destroyed afterwards, nothing of it is referenced
+		explicit Quantized_Mesh(const Mesh& mesh, Vertex_Quantization quantization = Vertex_Quantization::BITS_16)
+			: Quantized_Mesh(mesh.vertices(), mesh.indices(), mesh.bvh(), mesh.color(), mesh.shininess(), quantization) {}
+		// Straight from an OBJ or its mesh cache, see Mesh::load_geometry. No Mesh is built, so the
+		// peak is the full precision vertices, indices and BVH plus the quantized copy; all but
+		// the copy are freed on return.
+		Quantized_Mesh(const std::string& filename, const HDR_rgb& color, real shininess,
+			Vertex_Quantization quantization = Vertex_Quantization::BITS_16,
+			const BVH_Build_Options& options = BVH_Build_Options(), bool use_cache = true)
+			: Abstract_Object(color, shininess), quantization_(quantization) {
+			Mesh::vertex_storage_type vertices;
+			Mesh::index_storage_type indices;
+			BVH bvh;
+			Mesh::load_geometry(filename, options, use_cache, vertices, indices, bvh);
+			quantize(vertices, indices, std::move(bvh));
+		}
+		// Triangle i has the corners vertices[indices[3 * i + corner]] and is triangle i of bvh's leaves
+		Quantized_Mesh(const Mesh::vertex_storage_type& vertices, const Mesh::index_storage_type& indices, BVH bvh,
+			const HDR_rgb& color, real shininess, Vertex_Quantization quantization = Vertex_Quantization::BITS_16)
+			: Abstract_Object(color, shininess), quantization_(quantization) {
+			quantize(vertices, indices, std::move(bvh));
+		}
+
+		size_t size() const { return size_; }
+		Vertex_Quantization quantization() const { return quantization_; }
+		real max_error() const { return max_error_; }
+		const BVH& bvh() const { return bvh_; }
+		void bvh_layout(BVH_Layout layout) { bvh_.layout(layout); }
+		size_t memory_bytes() const {
+			return blocks_.size() * sizeof(Block) + coordinates_16_.size() * sizeof(uint16_t) + coordinates_21_.size() * sizeof(uint64_t)
+				+ bvh_.nodes().size() * sizeof(BVH::Node) + bvh_.primitive_indices().size() * sizeof(uint32_t);
+		}
+
+		// Decoded corner of a triangle
+		Point vertex(size_t triangle, size_t corner) const {
+			const Block& block = blocks_[triangle / BLOCK_SIZE];
+			Point result;
+			for (size_t axis = 0; axis < 3; ++axis)
+				result[axis] = block.origin[axis] + static_cast<float>(offset(triangle, corner, axis)) * step_[axis];
+			return result;
+		}
+
+		virtual Bounding_Box bounding_box() const { return bvh_.bounding_box(); }
+
+		virtual std::optional<Intersection> intersect(const Ray& ray, real t_min, real t_max) const {
+			assert(t_min < t_max);
+			Hit_Record record(t_max);
+			if (!find_hit(ray, t_min, record))
+				return std::nullopt;
+			return make_intersection(ray, record);
+		}
+
+		virtual bool find_hit(const Ray& ray, real t_min, Hit_Record& record) const {
+			Triangle_SoA::Ray_Data ray_data(ray);
+			uint32_t best = NO_HIT;
+			real t_max = record.t;
+			bvh_.traverse_leaves(ray, t_min, t_max, [&](uint32_t first, uint32_t count, real& t_max) {
+				float t = static_cast<float>(t_max);
+				uint32_t hit = closest_hit(ray_data, first, count, static_cast<float>(t_min), t);
+				if (hit != NO_HIT && t < t_max) {
+					best = hit;
+					t_max = t;
+				}
+			});
+			if (best == NO_HIT)
+				return false;
+			record = Hit_Record(t_max);
+			record.object = this;
+			record.primitive = best;
+			Decoded decoded;
+			decode(best, 1, decoded);
+			Triangle_SoA::barycentrics(decoded.lanes(), ray_data, 0, record.u, record.v);
+			return true;
+		}
+
+		virtual Intersection make_intersection(const Ray& ray, const Hit_Record& record) const {
+			Point a = vertex(record.primitive, 0);
+			Direction normal = (vertex(record.primitive, 1) - a).cross(vertex(record.primitive, 2) - a).normalized();
+			return Intersection(this, ray.point_along_ray(record.t), record.t, normal);
+		}
+
+		virtual bool occluded(const Ray& ray, real t_min, real t_max) const {
+			uint32_t primitive;
+			return find_occluder(ray, t_min, t_max, primitive);
+		}
+
+		virtual bool find_occluder(const Ray& ray, real t_min, real t_max, uint32_t& primitive) const {
+			Triangle_SoA::Ray_Data ray_data(ray);
+			return bvh_.occluded_leaves(ray, t_min, t_max, [&](uint32_t first, uint32_t count) {
+				uint32_t hit = first_hit(ray_data, first, count, static_cast<float>(t_min), static_cast<float>(t_max));
+				if (hit == NO_HIT)
+					return false;
+				primitive = hit;
+				return true;
+			});
+		}
+
+		virtual bool occluded_by(const Ray& ray, real t_min, real t_max, uint32_t primitive) const {
+			assert(primitive < size());
+			return first_hit(Triangle_SoA::Ray_Data(ray), primitive, 1, static_cast<float>(t_min), static_cast<float>(t_max)) != NO_HIT;
+		}
+
+	private:
+		struct Block {
+			float origin[3];	// on the grid of step_
+		};
+
+		static constexpr uint32_t CHUNK = 16;	// triangles decoded at a time
+
+		// Triangles decoded into the lanes Triangle_SoA's kernels read
+		struct Decoded {
+			alignas(32) std::array<std::array<float, CHUNK + Triangle_SoA::PADDING>, Triangle_SoA::COMPONENTS> data;
+			Triangle_SoA::Lanes lanes() const {
+				Triangle_SoA::Lanes result;
+				for (size_t i = 0; i < Triangle_SoA::COMPONENTS; ++i)
+					result[i] = data[i].data();
+				return result;
+			}
+		};
+
+		// Quantizes triangle i = vertices[indices[3 * i + corner]], in the leaf order of bvh
+		void quantize(const Mesh::vertex_storage_type& vertices, const Mesh::index_storage_type& indices, BVH bvh) {
+			assert(indices.size() % 3 == 0);
+			size_ = indices.size() / 3;
+			uint32_t levels = (quantization_ == Vertex_Quantization::BITS_21) ? 0x1FFFFF : 0xFFFF;
+			blocks_.resize((size_ + BLOCK_SIZE - 1) / BLOCK_SIZE);
+			if (quantization_ == Vertex_Quantization::BITS_21)
+				coordinates_21_.assign(3 * size_, 0);
+			else
+				coordinates_16_.assign(9 * size_, 0);
+			std::vector<Bounding_Box> bounds(blocks_.size());
+			std::array<double, 3> widest = { 0.0, 0.0, 0.0 }, largest = { 0.0, 0.0, 0.0 };
+			for (size_t b = 0; b < blocks_.size(); ++b) {
+				for (size_t i = b * BLOCK_SIZE; i < std::min(size_, (b + 1) * BLOCK_SIZE); ++i)
+					for (size_t corner = 0; corner < 3; ++corner)
+						bounds[b].expand(vertices[indices[3 * i + corner]]);
+				for (size_t axis = 0; axis < 3; ++axis) {
+					widest[axis] = std::max<double>(widest[axis], bounds[b].max()[axis] - bounds[b].min()[axis]);
+					largest[axis] = std::max<double>(largest[axis], std::max(std::abs(bounds[b].min()[axis]), std::abs(bounds[b].max()[axis])));
+				}
+			}
+			for (size_t axis = 0; axis < 3; ++axis) {
+				// An offset is at most extent / step + 1.5 once rounded to the nearest grid point.
+				// Steps of at least the float spacing keep every grid point of the mesh a float.
+				float above = std::nextafter(static_cast<float>(largest[axis]), std::numeric_limits<float>::infinity());
+				float spacing = std::nextafter(above, std::numeric_limits<float>::infinity()) - above;
+				step_[axis] = static_cast<float>(std::max(grid_step(widest[axis] / (levels - 2)), grid_step(spacing)));
+				max_error_ = std::max(max_error_, real(0.5) * step_[axis]);
+			}
+			for (size_t b = 0; b < blocks_.size(); ++b) {
+				Block& block = blocks_[b];
+				std::array<double, 3> origin_index;
+				for (size_t axis = 0; axis < 3; ++axis) {
+					origin_index[axis] = std::floor(bounds[b].min()[axis] / step_[axis]);
+					block.origin[axis] = static_cast<float>(origin_index[axis] * step_[axis]);
+					assert(double(block.origin[axis]) == origin_index[axis] * step_[axis]);
+				}
+				for (size_t i = b * BLOCK_SIZE; i < std::min(size_, (b + 1) * BLOCK_SIZE); ++i) {
+					for (size_t corner = 0; corner < 3; ++corner) {
+						const Point& p = vertices[indices[3 * i + corner]];
+						for (size_t axis = 0; axis < 3; ++axis) {
+							// The nearest grid point, whatever block the vertex is quantized in
+							double grid_index = std::floor(p[axis] / step_[axis] + 0.5);
+							assert(grid_index >= origin_index[axis] && grid_index - origin_index[axis] <= levels);
+							uint64_t q = static_cast<uint64_t>(grid_index - origin_index[axis]);
+							if (quantization_ == Vertex_Quantization::BITS_21)
+								coordinates_21_[3 * i + corner] |= q << (21 * axis);
+							else
+								coordinates_16_[9 * i + 3 * corner + axis] = static_cast<uint16_t>(q);
+						}
+					}
+				}
+			}
+			bvh_ = std::move(bvh);
+			bvh_.refit([&](uint32_t first, uint32_t count) {
+				Bounding_Box box;
+				for (uint32_t i = first; i < first + count; ++i)
+					for (size_t corner = 0; corner < 3; ++corner)
+						box.expand(vertex(i, corner));
+				return box;
+			});
+		}
+
+		// The smallest power of two >= x, or 0 for x = 0
+		static double grid_step(double x) {
+			if (x <= 0.0)
+				return 0.0;
+			int exponent;
+			double mantissa = std::frexp(x, &exponent);
+			return std::ldexp(1.0, (mantissa == 0.5) ? exponent - 1 : exponent);
+		}
+
+		uint32_t offset(size_t triangle, size_t corner, size_t axis) const {
+			if (quantization_ == Vertex_Quantization::BITS_21)
+				return static_cast<uint32_t>((coordinates_21_[3 * triangle + corner] >> (21 * axis)) & 0x1FFFFF);
+			return coordinates_16_[9 * triangle + 3 * corner + axis];
+		}
+
+		void decode(uint32_t first, uint32_t count, Decoded& decoded) const {
+			assert(count <= CHUNK);
+			for (uint32_t i = 0; i < count; ++i) {
+				Point a = vertex(first + i, 0), b = vertex(first + i, 1), c = vertex(first + i, 2);
+				for (size_t axis = 0; axis < 3; ++axis) {
+					decoded.data[Triangle_SoA::V0 + axis][i] = static_cast<float>(a[axis]);
+					decoded.data[Triangle_SoA::E1 + axis][i] = static_cast<float>(b[axis] - a[axis]);
+					decoded.data[Triangle_SoA::E2 + axis][i] = static_cast<float>(c[axis] - a[axis]);
+				}
+			}
+			for (auto& component : decoded.data)
+				std::fill(component.begin() + count, component.begin() + count + Triangle_SoA::PADDING, 0.0f);
+		}
+
+		// Closest hit over [first, first + count), decoded a chunk at a time
+		uint32_t closest_hit(const Triangle_SoA::Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float& t_max) const {
+			uint32_t best = NO_HIT;
+			Decoded decoded;
+			for (uint32_t chunk = first; chunk < first + count; chunk += CHUNK) {
+				uint32_t chunk_count = std::min(CHUNK, first + count - chunk);
+				decode(chunk, chunk_count, decoded);
+				uint32_t hit = Triangle_SoA::closest_hit(decoded.lanes(), ray, 0, chunk_count, t_min, t_max);
+				if (hit != NO_HIT)
+					best = chunk + hit;
+			}
+			return best;
+		}
+		// Some hit over [first, first + count), decoding no chunk after the one holding it
+		uint32_t first_hit(const Triangle_SoA::Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float t_max) const {
+			Decoded decoded;
+			for (uint32_t chunk = first; chunk < first + count; chunk += CHUNK) {
+				uint32_t chunk_count = std::min(CHUNK, first + count - chunk);
+				decode(chunk, chunk_count, decoded);
+				uint32_t hit = Triangle_SoA::first_hit(decoded.lanes(), ray, 0, chunk_count, t_min, t_max);
+				if (hit != NO_HIT)
+					return chunk + hit;
+			}
+			return NO_HIT;
+		}
+
+		Vertex_Quantization quantization_;
+		size_t size_;
+		real max_error_ = 0.0;
+		float step_[3];
+		std::vector<Block> blocks_;
+		std::vector<uint16_t> coordinates_16_;		// 9 per triangle: corners, then axes
+		std::vector<uint64_t> coordinates_21_;		// 3 per triangle: one corner, 21 bits per axis
+		BVH bvh_;
+	};
+
+}
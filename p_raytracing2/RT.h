@@ -5,15 +5,36 @@
 #include "HDR_RGB.h"
 #include "Image.h"
 #include "Matrix.h"
+#include "Transform.h"
 #include "PPM_Writer.h"
 #include "Misc.h"
 #include "Ray.h"
+#include "Ray_Packet.h"
+#include "Hit_Record.h"
+#include "Bounding_Box.h"
+#include "SIMD.h"
+#include "Wide_BVH.h"
+#include "BVH.h"
 #include "Viewport.h"
 #include "Projection.h"
 #include "Sphere_Object.h"
+#include "Sphere_SoA.h"
+#include "Sphere_Set.h"
 #include "Scene.h"
 #include "Triangle_Object.h"
+#include "Triangle_SoA.h"
+#include "Mapped_File.h"
+#include "Mesh_Cache.h"
 #include "Mesh.h"
+#include "Quantized_Mesh.h"
+#include "Instance.h"
 #include "Abstract_Shader.h"
 #include "Blinn_Phong_Shader.h"
-#include "Flat_Shader.h"
\ No newline at end of file
+#include "Flat_Shader.h"
+#include "Thread_Pool.h"
+#include "Tile_Renderer.h"
+#include "Distributed_Renderer.h"
+#include "Camera_Path.h"
+#include "Animation_Renderer.h"
+#include "Wavefront_Renderer.h"
+#include "Occluder_Cache.h"
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
 #include "Vector.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 
 namespace RT {
 
@@ -10,20 +13,37 @@ namespace RT {
 		Ray(const Ray& r) = default;
 		Ray& operator=(const Ray& r) = default;
 		Ray(const Point& origin, const Direction& direction) : origin_(origin), direction_(direction.normalized()) {}
+		// For a direction that is unit length already, as normalized() returns it; kept bit for bit
+		static Ray with_unit_direction(const Point& origin, const Direction& direction) { return Ray(origin, direction, Unit()); }
 
 		const Point& origin() const { return origin_; }
 		const Direction& direction() const { return direction_; }
 
-		Point point_along_ray(double t) const { return origin_ + direction_*t; }
+		Point point_along_ray(real t) const { return origin_ + direction_*t; }
 
 		friend std::ostream& operator<<(std::ostream& out, const Ray& ray) {
 			return out << "origin=" << ray.origin() << " direction=" << ray.direction();
 		}
 
 	private:
+		struct Unit {};
+		Ray(const Point& origin, const Direction& direction, Unit) : origin_(origin), direction_(direction) {}
+
 		Point origin_;
 		Direction direction_;
 	};
 
+	// Smallest t accepted on rays that start at the camera or on a surface
+	const real RAY_EPSILON = real(0.01);
+	// Rounding error of a computed hit point, relative to its largest coordinate
+	const real RELATIVE_RAY_EPSILON = 64 * std::numeric_limits<real>::epsilon();
+
+	// t_min for a ray leaving a surface at origin, so it does not hit that surface again (shadow
+	// acne). Never below RAY_EPSILON, and growing with the coordinates, since the error of the
+	// hit point does too; in a single precision build that happens much closer to the origin.
+	inline real ray_epsilon(const Point& origin) {
+		real magnitude = std::max({ std::abs(origin[0]), std::abs(origin[1]), std::abs(origin[2]) });
+		return std::max(RAY_EPSILON, magnitude * RELATIVE_RAY_EPSILON);
+	}
 
-}
\ No newline at end of file
+}
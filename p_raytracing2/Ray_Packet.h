@@ -0,0 +1,247 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "Misc.h"
+#include "SIMD.h"
+#include "Vector.h"
+#include "Ray.h"
+#include "Bounding_Box.h"
+
+namespace RT {
+
+	// Up to 64 rays traced together, e.g. the primary rays of an 8x8 pixel block. Each ray
+	// keeps its own t_max; bit i of an active mask selects ray i.
+	//
+	// The packet also keeps intervals over its origins and inverse directions, which bound the
+	// slab distances of every ray at once (interval arithmetic). These only make sense while all
+	// directions lie in one octant; a packet that is not coherent should be traced ray by ray.
+	// Single precision copies of the rays, laid out as structure of arrays, let intersect() test
+	// four rays against a box per SSE instruction, or eight with AVX2.
+	class Ray_Packet {
+	public:
+		static const size_t MAX_SIZE = 64;
+
+	public:
+		Ray_Packet() {
+			for (auto& component : lanes_)
+				component.fill(0.0f);
+			rays_.reserve(MAX_SIZE);
+			inv_directions_.reserve(MAX_SIZE);
+			t_max_.reserve(MAX_SIZE);
+			clear();
+		}
+
+		void clear() {
+			rays_.clear();
+			inv_directions_.clear();
+			t_max_.clear();
+			origin_min_ = Point(REAL_INFINITY);
+			origin_max_ = Point(REAL_NEGATIVE_INFINITY);
+			inv_min_ = Vector3<real>(REAL_INFINITY);
+			inv_max_ = Vector3<real>(REAL_NEGATIVE_INFINITY);
+			largest_t_max_ = REAL_NEGATIVE_INFINITY;
+			largest_t_max_dirty_ = false;
+			coherent_ = true;
+		}
+
+		void add(const Ray& ray, real t_max = REAL_INFINITY) {
+			assert(rays_.size() < MAX_SIZE);
+			Vector3<real> inv_direction;
+			for (size_t i = 0; i < 3; ++i) {
+				inv_direction[i] = 1.0 / ray.direction()[i];
+				origin_min_[i] = std::min(origin_min_[i], ray.origin()[i]);
+				origin_max_[i] = std::max(origin_max_[i], ray.origin()[i]);
+				inv_min_[i] = std::min(inv_min_[i], inv_direction[i]);
+				inv_max_[i] = std::max(inv_max_[i], inv_direction[i]);
+				// Infinite inverses would turn the interval products into NaN
+				if (ray.direction()[i] == 0.0 || (inv_min_[i] < 0.0 && inv_max_[i] > 0.0))
+					coherent_ = false;
+			}
+			size_t lane = rays_.size();
+			for (size_t i = 0; i < 3; ++i) {
+				lanes_[ORIGIN + i][lane] = static_cast<float>(ray.origin()[i]);
+				lanes_[INV_DIRECTION + i][lane] = static_cast<float>(inv_direction[i]);
+			}
+			lanes_[FAR][lane] = far_limit(t_max);
+			rays_.push_back(ray);
+			inv_directions_.push_back(inv_direction);
+			t_max_.push_back(t_max);
+			largest_t_max_ = std::max(largest_t_max_, t_max);
+		}
+
+		size_t size() const { return rays_.size(); }
+		bool is_empty() const { return rays_.empty(); }
+		bool is_coherent() const { return coherent_; }
+		uint64_t all() const { return (size() == MAX_SIZE) ? ~uint64_t(0) : (uint64_t(1) << size()) - 1; }
+
+		const Ray& ray(size_t i) const { return rays_[i]; }
+		const Vector3<real>& inv_direction(size_t i) const { return inv_directions_[i]; }
+		real t_max(size_t i) const { return t_max_[i]; }
+		// Only ever shrinks a ray's t_max, as closest hit traversal does
+		void t_max(size_t i, real t) {
+			assert(t <= t_max_[i]);
+			t_max_[i] = t;
+			lanes_[FAR][i] = far_limit(t);
+			largest_t_max_dirty_ = true;
+		}
+		real largest_t_max() const {
+			if (largest_t_max_dirty_) {
+				largest_t_max_ = *std::max_element(t_max_.begin(), t_max_.end());
+				largest_t_max_dirty_ = false;
+			}
+			return largest_t_max_;
+		}
+
+		// Shared direction sign along axis; only meaningful for a coherent packet
+		bool negative(size_t axis) const { return inv_max_[axis] < 0.0; }
+
+		// Conservative for a coherent packet: false only if no ray enters the box within
+		// [t_min, its t_max]. One test for the whole packet, independent of its size.
+		bool may_intersect(const Bounding_Box& box, real t_min) const {
+			real near_t = t_min, far_t = largest_t_max();
+			for (size_t i = 0; i < 3; ++i) {
+				bool flip = negative(i);
+				real near_plane = flip ? box.max()[i] : box.min()[i];
+				real far_plane = flip ? box.min()[i] : box.max()[i];
+				near_t = std::max(near_t, lower_product(near_plane - origin_max_[i], near_plane - origin_min_[i], i));
+				far_t = std::min(far_t, upper_product(far_plane - origin_max_[i], far_plane - origin_min_[i], i));
+			}
+			return near_t <= far_t;
+		}
+
+		// Rays of mask that individually enter the box within [t_min, their t_max]. Conservative
+		// in single precision: a ray may be reported that just misses the box in full precision.
+		uint64_t intersect(const Bounding_Box& box, real t_min, uint64_t mask) const {
+#if defined(RT_SSE)
+			if (cpu_features().avx2)
+				return intersect_avx2(box, t_min, mask);
+			__m128 lower[3], upper[3];
+			for (size_t i = 0; i < 3; ++i) {
+				lower[i] = _mm_set1_ps(round_down(box.min()[i]));
+				upper[i] = _mm_set1_ps(round_up(box.max()[i]));
+			}
+			__m128 near_limit = _mm_set1_ps(round_down(t_min));
+			uint64_t result = 0;
+			for (size_t lane = 0; lane < size(); lane += 4) {
+				if (((mask >> lane) & 0xF) == 0)
+					continue;
+				__m128 near_t = near_limit, far_t = _mm_load_ps(&lanes_[FAR][lane]);
+				for (size_t i = 0; i < 3; ++i) {
+					__m128 origin = _mm_load_ps(&lanes_[ORIGIN + i][lane]);
+					__m128 inv = _mm_load_ps(&lanes_[INV_DIRECTION + i][lane]);
+					__m128 t0 = _mm_mul_ps(_mm_sub_ps(lower[i], origin), inv);
+					__m128 t1 = _mm_mul_ps(_mm_sub_ps(upper[i], origin), inv);
+					near_t = _mm_max_ps(near_t, _mm_min_ps(t0, t1));
+					far_t = _mm_min_ps(far_t, _mm_max_ps(t0, t1));
+				}
+				result |= static_cast<uint64_t>(_mm_movemask_ps(_mm_cmple_ps(near_t, far_t))) << lane;
+			}
+			return result & mask;
+#else
+			uint64_t result = 0;
+			for (; mask != 0; mask &= mask - 1) {
+				size_t i = lowest_bit(mask);
+				if (box.intersect(rays_[i].origin(), inv_directions_[i], t_min, t_max_[i]))
+					result |= uint64_t(1) << i;
+			}
+			return result;
+#endif
+		}
+
+#if defined(RT_SSE)
+		RT_TARGET_AVX2
+		uint64_t intersect_avx2(const Bounding_Box& box, real t_min, uint64_t mask) const {
+			__m256 lower[3], upper[3];
+			for (size_t i = 0; i < 3; ++i) {
+				lower[i] = _mm256_set1_ps(round_down(box.min()[i]));
+				upper[i] = _mm256_set1_ps(round_up(box.max()[i]));
+			}
+			__m256 near_limit = _mm256_set1_ps(round_down(t_min));
+			uint64_t result = 0;
+			for (size_t lane = 0; lane < size(); lane += 8) {
+				if (((mask >> lane) & 0xFF) == 0)
+					continue;
+				__m256 near_t = near_limit, far_t = _mm256_load_ps(&lanes_[FAR][lane]);
+				for (size_t i = 0; i < 3; ++i) {
+					__m256 origin = _mm256_load_ps(&lanes_[ORIGIN + i][lane]);
+					__m256 inv = _mm256_load_ps(&lanes_[INV_DIRECTION + i][lane]);
+					__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(lower[i], origin), inv);
+					__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(upper[i], origin), inv);
+					near_t = _mm256_max_ps(near_t, _mm256_min_ps(t0, t1));
+					far_t = _mm256_min_ps(far_t, _mm256_max_ps(t0, t1));
+				}
+				result |= static_cast<uint64_t>(_mm256_movemask_ps(_mm256_cmp_ps(near_t, far_t, _CMP_LE_OQ))) << lane;
+			}
+			return result & mask;
+		}
+#endif
+
+		static size_t bit_count(uint64_t mask) {
+			size_t count = 0;
+			for (; mask != 0; mask &= mask - 1)
+				++count;
+			return count;
+		}
+
+
+	private:
+		enum { ORIGIN = 0, INV_DIRECTION = 3, FAR = 6, LANE_COMPONENTS = 7 };
+
+		// Outward rounding to single precision, by more than the conversion error but cheaper than nextafter
+		static float round_down(real value) {
+			float rounded = static_cast<float>(value);
+			return rounded - (std::abs(rounded) * 2.4e-7f + std::numeric_limits<float>::min());
+		}
+		static float round_up(real value) {
+			float rounded = static_cast<float>(value);
+			return rounded + (std::abs(rounded) * 2.4e-7f + std::numeric_limits<float>::min());
+		}
+
+		// Widened like Wide_BVH's, so float rounding never culls a box the full precision test would hit
+		static float far_limit(real t_max) {
+			if (std::isinf(t_max))
+				return std::numeric_limits<float>::infinity();
+			return static_cast<float>(t_max) * 1.0000004f;
+		}
+
+		// Bounds of [lower, upper] * [inv_min_, inv_max_] along axis
+		real lower_product(real lower, real upper, size_t axis) const {
+			return std::min(std::min(lower * inv_min_[axis], lower * inv_max_[axis]), std::min(upper * inv_min_[axis], upper * inv_max_[axis]));
+		}
+		real upper_product(real lower, real upper, size_t axis) const {
+			return std::max(std::max(lower * inv_min_[axis], lower * inv_max_[axis]), std::max(upper * inv_min_[axis], upper * inv_max_[axis]));
+		}
+
+		alignas(32) std::array<std::array<float, MAX_SIZE>, LANE_COMPONENTS> lanes_;
+		std::vector<Ray> rays_;
+		std::vector<Vector3<real>> inv_directions_;
+		std::vector<real> t_max_;
+		Point origin_min_, origin_max_;
+		Vector3<real> inv_min_, inv_max_;
+		mutable real largest_t_max_;
+		mutable bool largest_t_max_dirty_ = false;
+		bool coherent_;
+	};
+
+	// Pixel offsets of a side x side block in Z-order, so rays that are close in a packet are
+	// also close on screen and the ray ranges of BVH::traverse_leaves() stay narrow
+	inline std::vector<std::array<size_t, 2>> packet_block_order(size_t side) {
+		std::vector<std::array<size_t, 2>> order;
+		for (size_t code = 0; order.size() < side * side; ++code) {
+			std::array<size_t, 2> offset = { 0, 0 };
+			for (size_t bit = 0; (code >> (2 * bit)) != 0; ++bit) {
+				offset[0] |= ((code >> (2 * bit)) & 1) << bit;
+				offset[1] |= ((code >> (2 * bit + 1)) & 1) << bit;
+			}
+			if (offset[0] < side && offset[1] < side)
+				order.push_back(offset);
+		}
+		return order;
+	}
+
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+// Instruction set selection for the vectorised kernels. SSE2 is part of every x64 target,
+// AVX is only used by code compiled for it (/arch:AVX, -mavx). Kernels marked
+// RT_TARGET_AVX2 are compiled for AVX2 regardless and must only be called after
+// cpu_features() reports it.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RT_SSE 1
+#include <immintrin.h>
+#endif
+#if defined(RT_SSE) && defined(__AVX__)
+#define RT_AVX 1
+#endif
+
+#if defined(RT_SSE) && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define RT_TARGET_AVX2
+#elif defined(RT_SSE)
+#define RT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace RT {
+
+	// Number of float lanes of the widest vector unit the build targets
+#if defined(RT_AVX)
+	const size_t SIMD_FLOAT_WIDTH = 8;
+#elif defined(RT_SSE)
+	const size_t SIMD_FLOAT_WIDTH = 4;
+#else
+	const size_t SIMD_FLOAT_WIDTH = 1;
+#endif
+
+	// What the host CPU and operating system support, detected once
+	struct CPU_Features {
+		bool sse2 = false;
+		bool avx2 = false;
+	};
+
+	inline const CPU_Features& cpu_features() {
+		static const CPU_Features features = []() {
+			CPU_Features result;
+#if defined(RT_SSE) && defined(_MSC_VER) && !defined(__clang__)
+			int info[4];
+			__cpuid(info, 0);
+			int max_leaf = info[0];
+			__cpuid(info, 1);
+			result.sse2 = (info[3] & (1 << 26)) != 0;
+			bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;	// OSXSAVE, XMM and YMM state
+			if (max_leaf >= 7 && os_saves_ymm) {
+				__cpuidex(info, 7, 0);
+				result.avx2 = (info[1] & (1 << 5)) != 0;
+			}
+#elif defined(RT_SSE)
+			__builtin_cpu_init();
+			result.sse2 = __builtin_cpu_supports("sse2");
+			result.avx2 = __builtin_cpu_supports("avx2");
+#endif
+			return result;
+		}();
+		return features;
+	}
+
+	// x[i] = sqrt(x[i]) over an array. std::sqrt stays scalar in loops as it may set errno, the
+	// SSE square roots give the same correctly rounded results.
+	inline void sqrt_lanes(double* x, size_t count) {
+		size_t i = 0;
+#if defined(RT_SSE)
+		for (; i + 2 <= count; i += 2)
+			_mm_storeu_pd(x + i, _mm_sqrt_pd(_mm_loadu_pd(x + i)));
+#endif
+		for (; i < count; ++i)
+			x[i] = std::sqrt(x[i]);
+	}
+	inline void sqrt_lanes(float* x, size_t count) {
+		size_t i = 0;
+#if defined(RT_SSE)
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(x + i, _mm_sqrt_ps(_mm_loadu_ps(x + i)));
+#endif
+		for (; i < count; ++i)
+			x[i] = std::sqrt(x[i]);
+	}
+
+	// Implementation of the vectorised primitive kernels (Triangle_SoA, Sphere_SoA). AVX2 tests
+	// 8 primitives per instruction, SSE 4, and the scalar kernel one at a time.
+	enum class SIMD_Kernel { SCALAR, SSE, AVX2 };
+
+	inline std::ostream& operator<<(std::ostream& out, SIMD_Kernel kernel) {
+		switch (kernel) {
+		case SIMD_Kernel::AVX2: return out << "avx2";
+		case SIMD_Kernel::SSE:  return out << "sse";
+		default:				return out << "scalar";
+		}
+	}
+
+	// The fastest kernel no wider than the one asked for that the CPU supports
+	inline SIMD_Kernel supported_kernel(SIMD_Kernel kernel = SIMD_Kernel::AVX2) {
+		if (kernel == SIMD_Kernel::AVX2 && !cpu_features().avx2)
+			kernel = SIMD_Kernel::SSE;
+		if (kernel == SIMD_Kernel::SSE && !cpu_features().sse2)
+			kernel = SIMD_Kernel::SCALAR;
+		return kernel;
+	}
+
+	// Primitives one kernel iteration tests
+	inline size_t kernel_width(SIMD_Kernel kernel) {
+		return (kernel == SIMD_Kernel::AVX2) ? 8 : (kernel == SIMD_Kernel::SSE) ? 4 : 1;
+	}
+
+	// The kernel every vectorised primitive runs, picked from cpu_features() on first use.
+	// Setting it is meant for benchmarks and has to happen before rendering starts.
+	inline SIMD_Kernel& kernel_selection() {
+		static SIMD_Kernel kernel = supported_kernel();
+		return kernel;
+	}
+	inline SIMD_Kernel active_kernel() { return kernel_selection(); }
+	inline void active_kernel(SIMD_Kernel kernel) { kernel_selection() = supported_kernel(kernel); }
+
+	// Index of the lowest set bit, of a lane mask for example
+	inline uint32_t lowest_bit(uint64_t mask) {
+		assert(mask != 0);
+		uint32_t bit = 0;
+		while ((mask & 1u) == 0) {
+			mask >>= 1;
+			++bit;
+		}
+		return bit;
+	}
+
+#if defined(RT_SSE)
+	// Lane by lane dot products of vectors given as three component registers
+	inline __m128 dot_sse(const __m128 a[3], const __m128 b[3]) {
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+	}
+	RT_TARGET_AVX2
+	inline __m256 dot_avx2(const __m256 a[3], const __m256 b[3]) {
+		return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[0], b[0]), _mm256_mul_ps(a[1], b[1])), _mm256_mul_ps(a[2], b[2]));
+	}
+#endif
+
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <vector>
 #include "Camera.h"
@@ -7,8 +9,17 @@
 #include "HDR_RGB.h"
 #include "Abstract_Object.h"
 #include "Abstract_Shader.h"
+#include "BVH.h"
+#include "Ray_Packet.h"
+#include "Hit_Record.h"
 #include "Mesh.h"
+#include "Quantized_Mesh.h"
+#include "Sphere_Object.h"
+#include "Sphere_Set.h"
+#include "Instance.h"
+#include "Triangle_Object.h"
 #include "Light.h"
+#include "Light_BVH.h"
 
 namespace RT {
 
@@ -22,9 +33,9 @@ namespace RT {
 		Scene(Scene&& s) = default;
 		Scene& operator=(const Scene& s) = default;
 		Scene& operator=(Scene&& s) = default;
-		Scene() : camera_(nullptr), viewport_(nullptr), projection_(nullptr), background_(BLACK) {}
+		Scene() : camera_(nullptr), viewport_(nullptr), projection_(nullptr), background_(BLACK), bvh_dirty_(false) {}
 		Scene(Camera *camera, Viewport *viewport, Abstract_Projection *projection, Abstract_Shader* shader, const HDR_rgb& background)
-			: camera_(camera), viewport_(viewport), projection_(projection), shader_(shader), background_(background) {
+			: camera_(camera), viewport_(viewport), projection_(projection), shader_(shader), background_(background), bvh_dirty_(false) {
 			assert(camera_); assert(viewport_); assert(projection_); assert(shader_);
 			assert(complete());
 		}
@@ -35,10 +46,13 @@ namespace RT {
 		const Viewport&				viewport()	 const { assert(viewport_);   return *viewport_; }
 		const Abstract_Projection&	projection() const { assert(projection_); return *projection_; }
 		const Abstract_Shader&		shader()	 const { assert(shader_);	  return *shader_; }
+		const HDR_rgb&				background() const { return background_; }
 		const object_storage_type& objects() const { return objects_; }
 		size_t object_count() const { return objects_.size(); }
 		const light_storage_type& lights() const { return lights_; }
-		const Light& light(size_t i) const { return *lights_[i]; }
+		const Light& light(size_t i) const { assert(!bvh_dirty_); return *lights_[i]; }
+		const BVH& bvh() const { return bvh_; }
+		const Light_BVH& light_bvh() const { assert(!bvh_dirty_); return light_bvh_; }
 
 
 		void camera(Camera* cam) { camera_ = cam; }
@@ -48,30 +62,214 @@ namespace RT {
 		void background(const HDR_rgb& backg) { background_ = backg; }
 
 
-		void add_light(Light* lig) { lights_.push_back(lig); }
-		void add_object(Abstract_Object* obj) { objects_.push_back(obj); }
-		void add_object(Mesh* obj) {
-			for (auto& i : *obj)
-				objects_.push_back(i);
+		// Lights are shaded through the Light_BVH, so they too need build_bvh() afterwards
+		void add_light(Light* lig) { lights_.push_back(lig); bvh_dirty_ = true; }
+		// Meshes are added whole, their own BVH is kept and only the top level is rebuilt
+		void add_object(Abstract_Object* obj) { objects_.push_back(obj); bvh_dirty_ = true; }
+
+		// Must be called after the last add_object() and before tracing any rays. This only
+		// rebuilds the top level BVH over the objects, which is cheap next to the meshes' own.
+		// The objects are then regrouped by type in BVH leaf order, see Object_Type. The lights
+		// get their Light_BVH, so they too must be added before.
+		void build_bvh(const BVH_Build_Options& options = BVH_Build_Options()) {
+			light_bvh_.build(lights_);
+			build_id_.renew();
+			std::vector<Bounding_Box> boxes(objects_.size());
+			for (size_t i = 0; i < objects_.size(); ++i)
+				boxes[i] = objects_[i]->bounding_box();
+			bvh_.build(boxes, options);
+			BVH::index_storage_type order = bvh_.take_primitive_order();
+			for (const BVH::Node& node : bvh_.nodes()) {
+				if (node.is_leaf())
+					std::stable_sort(order.begin() + node.offset, order.begin() + node.offset + node.count,
+						[&](uint32_t a, uint32_t b) { return object_type(objects_[a]) < object_type(objects_[b]); });
+			}
+			spheres_.clear();
+			triangles_.clear();
+			meshes_.clear();
+			quantized_meshes_.clear();
+			sphere_sets_.clear();
+			instances_.clear();
+			user_objects_.clear();
+			object_refs_.clear();
+			for (uint32_t i : order) {
+				const Abstract_Object* object = objects_[i];
+				Object_Type type = object_type(object);
+				switch (type) {
+				case Object_Type::SPHERE:	object_refs_.push_back({ type, add_ref(spheres_, *static_cast<const Sphere_Object*>(object)) }); break;
+				case Object_Type::TRIANGLE:	object_refs_.push_back({ type, add_ref(triangles_, *static_cast<const Triangle_Object*>(object)) }); break;
+				case Object_Type::MESH:		object_refs_.push_back({ type, add_ref(meshes_, static_cast<const Mesh*>(object)) }); break;
+				case Object_Type::QUANTIZED_MESH:	object_refs_.push_back({ type, add_ref(quantized_meshes_, static_cast<const Quantized_Mesh*>(object)) }); break;
+				case Object_Type::SPHERE_SET:	object_refs_.push_back({ type, add_ref(sphere_sets_, static_cast<const Sphere_Set*>(object)) }); break;
+				case Object_Type::INSTANCE:	object_refs_.push_back({ type, add_ref(instances_, static_cast<const Instance*>(object)) }); break;
+				default:					object_refs_.push_back({ type, add_ref(user_objects_, object) }); break;
+				}
+			}
+			bvh_dirty_ = false;
+		}
+
+		// Closest hit as a Hit_Record. Objects only report t and what identifies the hit, so
+		// candidates that are later beaten cost no Intersection.
+		Hit_Record closest_hit(const Ray& ray, real t_min = 0.0, real t_max = REAL_INFINITY) const {
+			assert(!bvh_dirty_);
+			Hit_Record record(t_max);
+			bvh_.traverse_leaves(ray, t_min, t_max, [&](uint32_t first, uint32_t count, real& t_max) {
+				for_each_run(first, count, [&](const auto* objects, uint32_t run) {
+					for (uint32_t i = 0; i < run; ++i)
+						if (element(objects, i).find_hit(ray, t_min, record))
+							t_max = record.t;
+				});
+			});
+			return record;
+		}
+
+		std::optional<Intersection> intersect(const Ray& ray, real t_min = 0.0, real t_max = REAL_INFINITY) const {
+			Hit_Record record = closest_hit(ray, t_min, t_max);
+			if (!record.is_hit())
+				return std::nullopt;
+			return record.object->make_intersection(ray, record);
 		}
 
-	
-		std::optional<Intersection> intersect(const Ray& ray, double t_min = 0.0, double t_max = DOUBLE_INFINITY) const {
-			std::optional<Intersection> best = std::nullopt;
-			std::optional<Intersection> temp = std::nullopt;
-			for (const auto& i : objects_) {
-				temp = i->intersect(ray, t_min, t_max);
-				if (temp != std::nullopt) {
-					if (temp->t() < t_max) {
-						best = temp;
-						t_max = temp->t();
+		// Any hit query for shadow rays: whether some object lies on the ray within [t_min, t_max).
+		// Stops at the first blocker found and never builds an Intersection.
+		bool occluded(const Ray& ray, real t_min, real t_max) const {
+			assert(!bvh_dirty_);
+			return bvh_.occluded_leaves(ray, t_min, t_max, [&](uint32_t first, uint32_t count) {
+				bool blocked = false;
+				for_each_run(first, count, [&](const auto* objects, uint32_t run) {
+					for (uint32_t i = 0; i < run && !blocked; ++i)
+						blocked = element(objects, i).occluded(ray, t_min, t_max);
+				});
+				return blocked;
+			});
+		}
+
+		// occluded() that also reports the blocker's object and primitive in occluder, whose t is
+		// not set. Either may be tested alone with occluded_by() on later rays.
+		bool find_occluder(const Ray& ray, real t_min, real t_max, Hit_Record& occluder) const {
+			assert(!bvh_dirty_);
+			return bvh_.occluded_leaves(ray, t_min, t_max, [&](uint32_t first, uint32_t count) {
+				bool blocked = false;
+				for_each_run(first, count, [&](const auto* objects, uint32_t run) {
+					for (uint32_t i = 0; i < run && !blocked; ++i) {
+						blocked = element(objects, i).find_occluder(ray, t_min, t_max, occluder.primitive);
+						if (blocked)
+							occluder.object = &element(objects, i);
 					}
+				});
+				return blocked;
+			});
+		}
+
+		// Build of the scene this is, distinct over all scenes of the process, so caches
+		// holding pointers into a scene can tell when it was rebuilt or replaced
+		uint64_t build_id() const { return build_id_.value(); }
+
+		// Closest hits for a whole packet, records[i] belongs to packet.ray(i). A coherent packet
+		// is traced together through both BVH levels, any other falls back to single rays.
+		void closest_hits(Ray_Packet& packet, real t_min, std::vector<Hit_Record>& records) const {
+			assert(!bvh_dirty_);
+			records.resize(packet.size());
+			for (size_t i = 0; i < packet.size(); ++i)
+				records[i] = Hit_Record(packet.t_max(i));
+			if (!packet.is_coherent()) {
+				for (size_t i = 0; i < packet.size(); ++i) {
+					records[i] = closest_hit(packet.ray(i), t_min, packet.t_max(i));
+					if (records[i].is_hit())
+						packet.t_max(i, records[i].t);
 				}
+				return;
 			}
-			return best;
+			bvh_.traverse_leaves(packet, t_min, packet.all(), [&](uint32_t first, uint32_t count, uint64_t mask) {
+				for_each_run(first, count, [&](const auto* objects, uint32_t run) {
+					for (uint32_t i = 0; i < run; ++i)
+						element(objects, i).find_hits(packet, t_min, mask, records.data());
+				});
+			});
 		}
 
 	private:
+		// A copy holds copies of the spheres and triangles and a move may leave its source
+		// empty, so both sides of either take a new id and no cache tests the objects of another scene
+		class Build_Id {
+		public:
+			Build_Id() = default;
+			Build_Id(const Build_Id&) {}
+			Build_Id(Build_Id&& other) { other.renew(); }
+			Build_Id& operator=(const Build_Id&) { renew(); return *this; }
+			Build_Id& operator=(Build_Id&& other) { renew(); other.renew(); return *this; }
+
+			void renew() { id_ = next(); }
+			uint64_t value() const { return id_; }
+
+		private:
+			static uint64_t next() {
+				static std::atomic<uint64_t> ids{ 0 };
+				return ++ids;
+			}
+
+			uint64_t id_ = next();
+		};
+
+		// The built in shapes are final, so calls through the typed arrays below are resolved at
+		// compile time and can be inlined; only USER objects go through the vtable. Spheres and
+		// triangles are stored by value, so hits on them point at the scene's copy.
+		enum class Object_Type : uint8_t { SPHERE, TRIANGLE, MESH, QUANTIZED_MESH, SPHERE_SET, INSTANCE, USER };
+		struct Object_Ref {
+			Object_Type type;
+			uint32_t index;		// into the array of that type
+		};
+
+		static Object_Type object_type(const Abstract_Object* object) {
+			if (dynamic_cast<const Sphere_Object*>(object))
+				return Object_Type::SPHERE;
+			if (dynamic_cast<const Triangle_Object*>(object))
+				return Object_Type::TRIANGLE;
+			if (dynamic_cast<const Mesh*>(object))
+				return Object_Type::MESH;
+			if (dynamic_cast<const Quantized_Mesh*>(object))
+				return Object_Type::QUANTIZED_MESH;
+			if (dynamic_cast<const Sphere_Set*>(object))
+				return Object_Type::SPHERE_SET;
+			if (dynamic_cast<const Instance*>(object))
+				return Object_Type::INSTANCE;
+			return Object_Type::USER;
+		}
+
+		template <typename element_type>
+		static uint32_t add_ref(std::vector<element_type>& objects, const element_type& object) {
+			objects.push_back(object);
+			return static_cast<uint32_t>(objects.size() - 1);
+		}
+
+		// The i-th object of a run, whether the typed array holds the objects or pointers to them
+		template <typename object_type>
+		static const object_type& element(const object_type* objects, uint32_t i) { return objects[i]; }
+		template <typename object_type>
+		static const object_type& element(const object_type* const* objects, uint32_t i) { return *objects[i]; }
+
+		// Splits the BVH leaf range [first, first + count) into runs of one type and calls
+		// visit(objects, run) with the run's consecutive entries in the typed array
+		template <typename visit_function>
+		void for_each_run(uint32_t first, uint32_t count, visit_function visit) const {
+			for (uint32_t end = first + count; first < end;) {
+				const Object_Ref& ref = object_refs_[first];
+				uint32_t run = 1;
+				while (first + run < end && object_refs_[first + run].type == ref.type)
+					++run;
+				switch (ref.type) {
+				case Object_Type::SPHERE:	visit(spheres_.data() + ref.index, run); break;
+				case Object_Type::TRIANGLE:	visit(triangles_.data() + ref.index, run); break;
+				case Object_Type::MESH:		visit(meshes_.data() + ref.index, run); break;
+				case Object_Type::QUANTIZED_MESH:	visit(quantized_meshes_.data() + ref.index, run); break;
+				case Object_Type::SPHERE_SET:	visit(sphere_sets_.data() + ref.index, run); break;
+				case Object_Type::INSTANCE:	visit(instances_.data() + ref.index, run); break;
+				default:					visit(user_objects_.data() + ref.index, run); break;
+				}
+				first += run;
+			}
+		}
+
 		Camera *camera_;
 		Viewport *viewport_;
 		Abstract_Projection *projection_;
@@ -79,6 +277,22 @@ namespace RT {
 		HDR_rgb background_;
 		object_storage_type objects_;
 		light_storage_type lights_;
+		BVH bvh_;
+		Light_BVH light_bvh_;
+		Build_Id build_id_;
+		std::vector<Object_Ref> object_refs_;		// in BVH leaf order, grouped by type within each leaf
+		std::vector<Sphere_Object> spheres_;		// copies, so a run is contiguous in memory
+		std::vector<Triangle_Object> triangles_;
+		std::vector<const Mesh*> meshes_;
+		std::vector<const Quantized_Mesh*> quantized_meshes_;
+		std::vector<const Sphere_Set*> sphere_sets_;
+		std::vector<const Instance*> instances_;
+		std::vector<const Abstract_Object*> user_objects_;
+		bool bvh_dirty_;
 	};
 
+	inline bool Abstract_Shader::light_visible(const Scene& scene, const Light&, const Ray& ray, real t_min, real t_max) const {
+		return !scene.occluded(ray, t_min, t_max);
+	}
+
 }
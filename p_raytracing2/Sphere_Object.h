@@ -7,48 +7,78 @@
 
 namespace RT {
 
-	class Sphere_Object : public Abstract_Object {
+	class Sphere_Object final : public Abstract_Object {
 	public:
 		Sphere_Object() = delete;
 		Sphere_Object(const Sphere_Object& sphere) = default;
-		Sphere_Object(const Point& center, double radius, const HDR_rgb& color, double shininess = 0.1) 
+		Sphere_Object(const Point& center, real radius, const HDR_rgb& color, real shininess = 0.1) 
 			: center_(center), radius_(radius), Abstract_Object(color,shininess)
 			{ assert(radius_ > 0.0); }
 
 		const Point& center() const { return center_; }
-		double radius() const { return radius_; }
+		real radius() const { return radius_; }
+		virtual Bounding_Box bounding_box() const {
+			return Bounding_Box(center_ - Point(radius_), center_ + Point(radius_));
+		}
 
-		virtual std::optional<Intersection> intersect(const Ray& ray, double t_min, double t_max) const {
+		virtual std::optional<Intersection> intersect(const Ray& ray, real t_min, real t_max) const {
 			assert(t_min < t_max);
-			Vector3<double> center_to_origin = ray.origin() - center_;
-			float a = dot(ray.direction(), ray.direction());
-			float b = dot(center_to_origin, ray.direction());
-			float c = dot(center_to_origin, center_to_origin) - radius_*radius_;
-			float discriminant = b*b - a*c;
-			if (discriminant > 0.0) {
-				float t = (-b - sqrt(discriminant))/a;
-				if (t_min <= t && t <= t_max) {
-					Point location = ray.point_along_ray(t);
-					Direction normal = (location - center_) / radius_;
-					return Intersection(this, location, t, normal);
-				}
-				t = (-b + sqrt(discriminant))/a;
-				if (t_min <= t && t <= t_max) {
-					Point location = ray.point_along_ray(t);
-					Direction normal = (location - center_) / radius_;
-					return Intersection(this, location, t, normal);
-				}
+			real t0, t1;
+			if (roots(ray, t0, t1)) {
+				if (t_min <= t0 && t0 <= t_max)
+					return make_intersection(ray, Hit_Record(t0));
+				if (t_min <= t1 && t1 <= t_max)
+					return make_intersection(ray, Hit_Record(t1));
 			}
 			return std::nullopt;
 		}
 
+		virtual bool find_hit(const Ray& ray, real t_min, Hit_Record& record) const {
+			real t0, t1;
+			if (!roots(ray, t0, t1))
+				return false;
+			real t = (t_min <= t0) ? t0 : t1;
+			if (!(t_min <= t && t < record.t))
+				return false;
+			record = Hit_Record(t);
+			record.object = this;
+			return true;
+		}
+
+		virtual Intersection make_intersection(const Ray& ray, const Hit_Record& record) const {
+			Point location = ray.point_along_ray(record.t);
+			Direction normal = (location - center_) / radius_;
+			return Intersection(this, location, record.t, normal);
+		}
+
+		virtual bool occluded(const Ray& ray, real t_min, real t_max) const {
+			real t0, t1;
+			if (!roots(ray, t0, t1))
+				return false;
+			return (t_min <= t0 && t0 < t_max) || (t_min <= t1 && t1 < t_max);
+		}
+
 		friend std::ostream& operator<<(std::ostream& out, const Sphere_Object& s_o) {
 			return out << "center=" << s_o.center() << " radius=" << s_o.radius() << " color=" << s_o.color();
 		}
 
 	private:
+		// Distances of both intersections with the sphere, near one first
+		bool roots(const Ray& ray, real& t0, real& t1) const {
+			Vector3<real> center_to_origin = ray.origin() - center_;
+			real a = dot(ray.direction(), ray.direction());
+			real b = dot(center_to_origin, ray.direction());
+			real c = dot(center_to_origin, center_to_origin) - radius_*radius_;
+			real discriminant = b*b - a*c;
+			if (discriminant <= 0.0)
+				return false;
+			t0 = (-b - sqrt(discriminant))/a;
+			t1 = (-b + sqrt(discriminant))/a;
+			return true;
+		}
+
 		Point center_;
-		double radius_;
+		real radius_;
 	};
 
 }
\ No newline at end of file
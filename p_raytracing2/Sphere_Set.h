@@ -0,0 +1,139 @@
+#pragma once
+#include <array>
+#include <cassert>
+#include <vector>
+#include "Abstract_Object.h"
+#include "Sphere_SoA.h"
+#include "HDR_RGB.h"
+#include "BVH.h"
+
+namespace RT {
+
+	// Many spheres of one material as a single object to the Scene, for particle or molecular
+	// data where a Sphere_Object per particle would cost an allocation and a virtual call each.
+	// The set owns a BVH over its spheres, and like a Mesh keeps them in its leaf order, so a
+	// leaf is one run of a Sphere_SoA tested 4 or 8 spheres at a time. A sphere test is cheap
+	// next to a node visit, so default_build_options() prices leaves by kernel iterations and
+	// builds a shallow tree of full leaves.
+	class Sphere_Set final : public Abstract_Object {
+	public:
+		Sphere_Set() = delete;
+		Sphere_Set(const Sphere_Set&) = delete;
+		Sphere_Set& operator=(const Sphere_Set&) = delete;
+		// spheres holds count spheres as x, y, z, radius; it is copied and can be freed afterwards
+		Sphere_Set(const real* spheres, size_t count, const HDR_rgb& color = HDR_rgb(), real shininess = 0.1,
+			const BVH_Build_Options& options = default_build_options())
+			: Abstract_Object(color, shininess) {
+			assert(count > 0);
+			std::vector<Bounding_Box> boxes(count);
+			for (size_t i = 0; i < count; ++i) {
+				const real* sphere = spheres + 4 * i;
+				assert(sphere[3] > 0.0);
+				Point center({ sphere[0], sphere[1], sphere[2] });
+				boxes[i] = Bounding_Box(center - Point(sphere[3]), center + Point(sphere[3]));
+			}
+			bvh_.build(boxes, options);
+			spheres_.assign(spheres, bvh_.take_primitive_order());
+		}
+
+		static BVH_Build_Options default_build_options() {
+			BVH_Build_Options options;
+			options.leaf_batch_size = kernel_width(active_kernel());
+			options.max_leaf_size = 2 * options.leaf_batch_size;
+			return options;
+		}
+
+		size_t size() const { return spheres_.size(); }
+		Point center(size_t i) const { return spheres_.center(i); }
+		real radius(size_t i) const { return spheres_.radius(i); }
+		size_t memory_bytes() const {
+			return spheres_.memory_bytes() + bvh_.nodes().size() * sizeof(BVH::Node) + bvh_.primitive_indices().size() * sizeof(uint32_t);
+		}
+		const BVH& bvh() const { return bvh_; }
+		void bvh_layout(BVH_Layout layout) { bvh_.layout(layout); }
+
+		virtual Bounding_Box bounding_box() const { return bvh_.bounding_box(); }
+
+		virtual std::optional<Intersection> intersect(const Ray& ray, real t_min, real t_max) const {
+			assert(t_min < t_max);
+			Hit_Record record(t_max);
+			if (!find_hit(ray, t_min, record))
+				return std::nullopt;
+			return make_intersection(ray, record);
+		}
+
+		virtual bool find_hit(const Ray& ray, real t_min, Hit_Record& record) const {
+			Sphere_SoA::Ray_Data ray_data(ray);
+			uint32_t best = Sphere_SoA::NO_HIT;
+			real t_max = record.t;
+			bvh_.traverse_leaves(ray, t_min, t_max, [&](uint32_t first, uint32_t count, real& t_max) {
+				float t = static_cast<float>(t_max);
+				uint32_t hit = spheres_.closest_hit(ray_data, first, count, static_cast<float>(t_min), t);
+				if (hit != Sphere_SoA::NO_HIT && t < t_max) {
+					best = hit;
+					t_max = t;
+				}
+			});
+			if (best == Sphere_SoA::NO_HIT)
+				return false;
+			record = Hit_Record(t_max);
+			record.object = this;
+			record.primitive = best;
+			return true;
+		}
+
+		virtual Intersection make_intersection(const Ray& ray, const Hit_Record& record) const {
+			Point location = ray.point_along_ray(record.t);
+			return Intersection(this, location, record.t, (location - center(record.primitive)) / radius(record.primitive));
+		}
+
+		virtual bool occluded(const Ray& ray, real t_min, real t_max) const {
+			uint32_t primitive;
+			return find_occluder(ray, t_min, t_max, primitive);
+		}
+
+		virtual bool find_occluder(const Ray& ray, real t_min, real t_max, uint32_t& primitive) const {
+			Sphere_SoA::Ray_Data ray_data(ray);
+			return bvh_.occluded_leaves(ray, t_min, t_max, [&](uint32_t first, uint32_t count) {
+				uint32_t hit = spheres_.first_hit(ray_data, first, count, static_cast<float>(t_min), static_cast<float>(t_max));
+				if (hit == Sphere_SoA::NO_HIT)
+					return false;
+				primitive = hit;
+				return true;
+			});
+		}
+
+		virtual bool occluded_by(const Ray& ray, real t_min, real t_max, uint32_t primitive) const {
+			assert(primitive < size());
+			return spheres_.any_hit(Sphere_SoA::Ray_Data(ray), primitive, 1, static_cast<float>(t_min), static_cast<float>(t_max));
+		}
+
+		virtual void find_hits(Ray_Packet& packet, real t_min, uint64_t active, Hit_Record* records) const {
+			if (!packet.is_coherent())
+				return Abstract_Object::find_hits(packet, t_min, active, records);
+			std::array<Sphere_SoA::Ray_Data, Ray_Packet::MAX_SIZE> ray_data;
+			for (uint64_t mask = active; mask != 0; mask &= mask - 1) {
+				size_t i = lowest_bit(mask);
+				ray_data[i] = Sphere_SoA::Ray_Data(packet.ray(i));
+			}
+			bvh_.traverse_leaves(packet, t_min, active, [&](uint32_t first, uint32_t count, uint64_t mask) {
+				for (; mask != 0; mask &= mask - 1) {
+					size_t i = lowest_bit(mask);
+					float t = static_cast<float>(packet.t_max(i));
+					uint32_t hit = spheres_.closest_hit(ray_data[i], first, count, static_cast<float>(t_min), t);
+					if (hit != Sphere_SoA::NO_HIT && t < packet.t_max(i)) {
+						packet.t_max(i, t);
+						records[i] = Hit_Record(t);
+						records[i].object = this;
+						records[i].primitive = hit;
+					}
+				}
+			});
+		}
+
+	private:
+		Sphere_SoA spheres_;
+		BVH bvh_;
+	};
+
+}
@@ -0,0 +1,206 @@
+#pragma once
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "SIMD.h"
+#include "Vector.h"
+#include "Ray.h"
+
+namespace RT {
+
+	// Spheres prepared for intersection, stored as structure of arrays in single precision:
+	// center and radius. Like Triangle_SoA, a BVH leaf over consecutive spheres is loaded
+	// straight into vector lanes.
+	class Sphere_SoA {
+	public:
+		static const uint32_t NO_HIT = std::numeric_limits<uint32_t>::max();
+		static const size_t PADDING = 8;	// zeroed floats after the last sphere, so full width loads stay in bounds
+
+		// A ray converted once per traversal instead of once per sphere
+		struct Ray_Data {
+			Ray_Data() = default;
+			explicit Ray_Data(const Ray& ray) {
+				for (size_t i = 0; i < 3; ++i) {
+					origin[i] = static_cast<float>(ray.origin()[i]);
+					direction[i] = static_cast<float>(ray.direction()[i]);
+				}
+				length_squared = direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2];
+			}
+			float origin[3];
+			float direction[3];
+			float length_squared;
+		};
+
+	public:
+		Sphere_SoA() = default;
+
+		// spheres holds x, y, z, radius per sphere; sphere i is stored from spheres[order[i]]
+		void assign(const real* spheres, const std::vector<uint32_t>& order) {
+			assert(order.size() < NO_HIT);
+			for (auto& component : data_)
+				component.assign(order.size() + PADDING, 0.0f);
+			for (size_t i = 0; i < order.size(); ++i)
+				for (size_t component = 0; component < COMPONENTS; ++component)
+					data_[component][i] = static_cast<float>(spheres[4 * size_t(order[i]) + component]);
+			size_ = order.size();
+		}
+
+		size_t size() const { return size_; }
+		size_t memory_bytes() const { return data_.size() * (size_ + PADDING) * sizeof(float); }
+		Point center(size_t i) const { return Point({ real(data_[X][i]), real(data_[Y][i]), real(data_[Z][i]) }); }
+		real radius(size_t i) const { return data_[RADIUS][i]; }
+
+		// Closest sphere of [first, first + count) entered or left within [t_min, t_max), like
+		// Sphere_Object::find_hit. Shrinks t_max to its distance, or returns NO_HIT.
+		// The discriminant comes from the distance between center and ray line instead of
+		// b*b - a*c, whose cancellation would lose small spheres far from the origin in floats.
+		uint32_t closest_hit(const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float& t_max) const {
+			return hit<false>(ray, first, count, t_min, t_max);
+		}
+
+		// Some sphere of the range hit within [t_min, t_max), or NO_HIT, like Triangle_SoA::first_hit
+		uint32_t first_hit(const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float t_max) const {
+			return hit<true>(ray, first, count, t_min, t_max);
+		}
+		bool any_hit(const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float t_max) const {
+			return first_hit(ray, first, count, t_min, t_max) != NO_HIT;
+		}
+
+		// FIRST returns the first hit found instead of the closest one
+		template <bool FIRST>
+		uint32_t hit(const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float& t_max) const {
+#if defined(RT_SSE)
+			switch (active_kernel()) {
+			case SIMD_Kernel::AVX2: return hit_avx2<FIRST>(ray, first, count, t_min, t_max);
+			case SIMD_Kernel::SSE:	return hit_sse<FIRST>(ray, first, count, t_min, t_max);
+			default: break;
+			}
+#endif
+			return hit_scalar<FIRST>(ray, first, count, t_min, t_max);
+		}
+
+		template <bool FIRST>
+		uint32_t hit_scalar(const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float& t_max) const {
+			uint32_t best = NO_HIT;
+			for (uint32_t i = first; i < first + count; ++i) {
+				float oc[3] = { ray.origin[0] - data_[X][i], ray.origin[1] - data_[Y][i], ray.origin[2] - data_[Z][i] };
+				float b = oc[0] * ray.direction[0] + oc[1] * ray.direction[1] + oc[2] * ray.direction[2];
+				float k = b / ray.length_squared;
+				float f[3] = { oc[0] - k * ray.direction[0], oc[1] - k * ray.direction[1], oc[2] - k * ray.direction[2] };
+				float discriminant = ray.length_squared * (data_[RADIUS][i] * data_[RADIUS][i] - (f[0] * f[0] + f[1] * f[1] + f[2] * f[2]));
+				if (discriminant <= 0.0f)
+					continue;
+				float root = std::sqrt(discriminant);
+				float t = (-b - root) / ray.length_squared;
+				if (t < t_min)
+					t = (-b + root) / ray.length_squared;
+				if (t_min <= t && t < t_max) {
+					if (FIRST)
+						return i;
+					t_max = t;
+					best = i;
+				}
+			}
+			return best;
+		}
+
+#if defined(RT_SSE)
+		template <bool FIRST>
+		uint32_t hit_sse(const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float& t_max) const {
+			const __m128 zero = _mm_setzero_ps(), infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+			const __m128 lane_index = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+			const __m128 o[3] = { _mm_set1_ps(ray.origin[0]), _mm_set1_ps(ray.origin[1]), _mm_set1_ps(ray.origin[2]) };
+			const __m128 d[3] = { _mm_set1_ps(ray.direction[0]), _mm_set1_ps(ray.direction[1]), _mm_set1_ps(ray.direction[2]) };
+			const __m128 a = _mm_set1_ps(ray.length_squared), t_lower = _mm_set1_ps(t_min);
+			uint32_t best = NO_HIT;
+			for (uint32_t base = first; base < first + count; base += 4) {
+				__m128 oc[3];
+				for (size_t axis = 0; axis < 3; ++axis)
+					oc[axis] = _mm_sub_ps(o[axis], _mm_loadu_ps(&data_[X + axis][base]));
+				__m128 radius = _mm_loadu_ps(&data_[RADIUS][base]);
+				__m128 b = dot_sse(oc, d);
+				__m128 k = _mm_div_ps(b, a);
+				__m128 f[3] = { _mm_sub_ps(oc[0], _mm_mul_ps(k, d[0])), _mm_sub_ps(oc[1], _mm_mul_ps(k, d[1])), _mm_sub_ps(oc[2], _mm_mul_ps(k, d[2])) };
+				__m128 discriminant = _mm_mul_ps(a, _mm_sub_ps(_mm_mul_ps(radius, radius), dot_sse(f, f)));
+				__m128 valid = _mm_cmplt_ps(lane_index, _mm_set1_ps(static_cast<float>(first + count - base)));
+				valid = _mm_and_ps(valid, _mm_cmpgt_ps(discriminant, zero));
+				if (_mm_movemask_ps(valid) == 0)
+					continue;
+				__m128 root = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+				__m128 minus_b = _mm_sub_ps(zero, b);
+				__m128 t0 = _mm_div_ps(_mm_sub_ps(minus_b, root), a);
+				__m128 t1 = _mm_div_ps(_mm_add_ps(minus_b, root), a);
+				__m128 near_ok = _mm_cmpge_ps(t0, t_lower);
+				__m128 t = _mm_or_ps(_mm_and_ps(near_ok, t0), _mm_andnot_ps(near_ok, t1));
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, t_lower), _mm_cmplt_ps(t, _mm_set1_ps(t_max))));
+				if (_mm_movemask_ps(valid) == 0)
+					continue;
+				if (FIRST)
+					return base + lowest_bit(static_cast<unsigned>(_mm_movemask_ps(valid)));
+				__m128 candidates = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, infinity));
+				__m128 minimum = _mm_min_ps(candidates, _mm_shuffle_ps(candidates, candidates, _MM_SHUFFLE(2, 3, 0, 1)));
+				minimum = _mm_min_ps(minimum, _mm_shuffle_ps(minimum, minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+				int lanes = _mm_movemask_ps(_mm_and_ps(valid, _mm_cmpeq_ps(candidates, minimum)));
+				t_max = _mm_cvtss_f32(minimum);
+				best = base + lowest_bit(static_cast<unsigned>(lanes));
+			}
+			return best;
+		}
+
+		template <bool FIRST>
+		RT_TARGET_AVX2
+		uint32_t hit_avx2(const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float& t_max) const {
+			const __m256 zero = _mm256_setzero_ps(), infinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+			const __m256 lane_index = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+			const __m256 o[3] = { _mm256_set1_ps(ray.origin[0]), _mm256_set1_ps(ray.origin[1]), _mm256_set1_ps(ray.origin[2]) };
+			const __m256 d[3] = { _mm256_set1_ps(ray.direction[0]), _mm256_set1_ps(ray.direction[1]), _mm256_set1_ps(ray.direction[2]) };
+			const __m256 a = _mm256_set1_ps(ray.length_squared), t_lower = _mm256_set1_ps(t_min);
+			uint32_t best = NO_HIT;
+			for (uint32_t base = first; base < first + count; base += 8) {
+				__m256 oc[3];
+				for (size_t axis = 0; axis < 3; ++axis)
+					oc[axis] = _mm256_sub_ps(o[axis], _mm256_loadu_ps(&data_[X + axis][base]));
+				__m256 radius = _mm256_loadu_ps(&data_[RADIUS][base]);
+				__m256 b = dot_avx2(oc, d);
+				__m256 k = _mm256_div_ps(b, a);
+				__m256 f[3] = { _mm256_sub_ps(oc[0], _mm256_mul_ps(k, d[0])), _mm256_sub_ps(oc[1], _mm256_mul_ps(k, d[1])),
+								_mm256_sub_ps(oc[2], _mm256_mul_ps(k, d[2])) };
+				__m256 discriminant = _mm256_mul_ps(a, _mm256_sub_ps(_mm256_mul_ps(radius, radius), dot_avx2(f, f)));
+				__m256 valid = _mm256_cmp_ps(lane_index, _mm256_set1_ps(static_cast<float>(first + count - base)), _CMP_LT_OQ);
+				valid = _mm256_and_ps(valid, _mm256_cmp_ps(discriminant, zero, _CMP_GT_OQ));
+				if (_mm256_movemask_ps(valid) == 0)
+					continue;
+				__m256 root = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+				__m256 minus_b = _mm256_sub_ps(zero, b);
+				__m256 t0 = _mm256_div_ps(_mm256_sub_ps(minus_b, root), a);
+				__m256 t1 = _mm256_div_ps(_mm256_add_ps(minus_b, root), a);
+				__m256 t = _mm256_blendv_ps(t1, t0, _mm256_cmp_ps(t0, t_lower, _CMP_GE_OQ));
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, t_lower, _CMP_GE_OQ),
+					_mm256_cmp_ps(t, _mm256_set1_ps(t_max), _CMP_LT_OQ)));
+				if (_mm256_movemask_ps(valid) == 0)
+					continue;
+				if (FIRST)
+					return base + lowest_bit(static_cast<unsigned>(_mm256_movemask_ps(valid)));
+				__m256 candidates = _mm256_blendv_ps(infinity, t, valid);
+				__m256 minimum = _mm256_min_ps(candidates, _mm256_permute_ps(candidates, _MM_SHUFFLE(2, 3, 0, 1)));
+				minimum = _mm256_min_ps(minimum, _mm256_permute_ps(minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+				minimum = _mm256_min_ps(minimum, _mm256_permute2f128_ps(minimum, minimum, 0x01));
+				int lanes = _mm256_movemask_ps(_mm256_and_ps(valid, _mm256_cmp_ps(candidates, minimum, _CMP_EQ_OQ)));
+				t_max = _mm256_cvtss_f32(minimum);
+				best = base + lowest_bit(static_cast<unsigned>(lanes));
+			}
+			return best;
+		}
+#endif
+
+	private:
+		enum { X = 0, Y = 1, Z = 2, RADIUS = 3, COMPONENTS = 4 };
+
+		std::array<std::vector<float>, COMPONENTS> data_;
+		size_t size_ = 0;
+	};
+
+}
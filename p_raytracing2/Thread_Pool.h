@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RT {
+
+	// Persistent worker threads with one task deque each. A worker takes its own newest task
+	// first and, once its deque runs dry, steals the oldest task of another worker, so uneven
+	// tasks (a tile of background next to a tile of dense mesh) still keep every thread busy.
+	// Tasks may submit further tasks; from a worker those go to its own deque.
+	class Thread_Pool {
+	public:
+		using task_type = std::function<void()>;
+
+	public:
+		Thread_Pool(const Thread_Pool&) = delete;
+		Thread_Pool& operator=(const Thread_Pool&) = delete;
+		// 0 threads means one per hardware thread
+		explicit Thread_Pool(size_t thread_count = 0) {
+			if (thread_count == 0)
+				thread_count = std::max(1u, std::thread::hardware_concurrency());
+			queues_.reserve(thread_count);
+			for (size_t i = 0; i < thread_count; ++i)
+				queues_.push_back(std::make_unique<Task_Queue>());
+			threads_.reserve(thread_count);
+			for (size_t i = 0; i < thread_count; ++i)
+				threads_.emplace_back([this, i]() { run(i); });
+		}
+		// Finishes the queued tasks first
+		~Thread_Pool() {
+			wait();
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stopping_ = true;
+			}
+			work_available_.notify_all();
+			for (auto& thread : threads_)
+				thread.join();
+		}
+
+		size_t size() const { return queues_.size(); }
+
+		// Queues task on the deque of worker, or of the calling worker when worker is NO_WORKER
+		// and the caller is one, else round robin
+		static const size_t NO_WORKER = static_cast<size_t>(-1);
+		void submit(task_type task, size_t worker = NO_WORKER) {
+			if (worker == NO_WORKER)
+				worker = (current_pool() == this) ? current_worker() : next_worker_++ % size();
+			assert(worker < size());
+			++pending_;
+			{
+				std::lock_guard<std::mutex> lock(queues_[worker]->mutex);
+				queues_[worker]->tasks.push_back(std::move(task));
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				++queued_;
+			}
+			work_available_.notify_one();
+		}
+
+		// Blocks until every submitted task has finished. Must not be called from a task.
+		void wait() {
+			assert(current_pool() != this);
+			std::unique_lock<std::mutex> lock(mutex_);
+			all_done_.wait(lock, [this]() { return pending_ == 0; });
+		}
+
+		// Index of the worker running the calling task, for per thread state
+		static size_t current_worker() { return worker_index(); }
+
+	private:
+		struct Task_Queue {
+			std::mutex mutex;
+			std::deque<task_type> tasks;
+		};
+
+		void run(size_t index) {
+			current_pool() = this;
+			worker_index() = index;
+			for (;;) {
+				task_type task;
+				if (take(index, task)) {
+					task();
+					finish();
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(mutex_);
+				work_available_.wait(lock, [this]() { return stopping_ || queued_ > 0; });
+				if (stopping_ && queued_ == 0)
+					return;
+			}
+		}
+
+		// Own newest task, else the oldest of the first other worker that has one
+		bool take(size_t index, task_type& task) {
+			if (pop(*queues_[index], task, false))
+				return true;
+			for (size_t i = 1; i < size(); ++i)
+				if (pop(*queues_[(index + i) % size()], task, true))
+					return true;
+			return false;
+		}
+
+		bool pop(Task_Queue& queue, task_type& task, bool oldest) {
+			{
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				if (queue.tasks.empty())
+					return false;
+				if (oldest) {
+					task = std::move(queue.tasks.front());
+					queue.tasks.pop_front();
+				}
+				else {
+					task = std::move(queue.tasks.back());
+					queue.tasks.pop_back();
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex_);
+			--queued_;
+			return true;
+		}
+
+		void finish() {
+			if (--pending_ == 0) {
+				std::lock_guard<std::mutex> lock(mutex_);
+				all_done_.notify_all();
+			}
+		}
+
+		static const Thread_Pool*& current_pool() {
+			thread_local const Thread_Pool* pool = nullptr;
+			return pool;
+		}
+		static size_t& worker_index() {
+			thread_local size_t index = 0;
+			return index;
+		}
+
+		std::vector<std::unique_ptr<Task_Queue>> queues_;
+		std::vector<std::thread> threads_;
+		std::mutex mutex_;							// guards queued_ and stopping_, and backs both conditions
+		std::condition_variable work_available_;
+		std::condition_variable all_done_;
+		size_t queued_ = 0;							// tasks sitting in deques
+		std::atomic<size_t> pending_{ 0 };			// tasks submitted and not yet finished
+		std::atomic<size_t> next_worker_{ 0 };
+		bool stopping_ = false;
+	};
+
+}
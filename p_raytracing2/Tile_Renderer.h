@@ -0,0 +1,195 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Scene.h"
+#include "Image.h"
+#include "PPM_Writer.h"
+#include "Ray.h"
+#include "Ray_Packet.h"
+#include "Thread_Pool.h"
+
+namespace RT {
+
+	struct Render_Options {
+		size_t thread_count = 0;	// 0 uses every hardware thread
+		size_t tile_size = 32;		// tiles are tile_size x tile_size pixels
+		size_t packet_side = 0;		// primary rays are traced in packet_side x packet_side blocks, 0 traces single rays
+		bool batch_shading = true;	// a tile's hits are shaded together by Abstract_Shader::shade_batch
+	};
+
+	// Pixel rectangle [x0, x1) x [y0, y1)
+	struct Tile {
+		size_t x0, y0, x1, y1;
+		size_t pixel_count() const { return (x1 - x0) * (y1 - y0); }
+	};
+
+	// Renders a Scene into an Image tile by tile on a persistent Thread_Pool, so rendering
+	// several frames starts no threads. Every worker is seeded with a contiguous band of tiles,
+	// which keeps neighbouring rays on one core, and work stealing evens out bands of unequal
+	// cost. Tiles write disjoint pixels and the Scene is only read, so no locking is needed.
+	class Tile_Renderer {
+	public:
+		Tile_Renderer() : Tile_Renderer(Render_Options()) {}
+		Tile_Renderer(const Tile_Renderer&) = delete;
+		Tile_Renderer& operator=(const Tile_Renderer&) = delete;
+		explicit Tile_Renderer(const Render_Options& options) : options_(options), pool_(options.thread_count) {
+			assert(options_.tile_size > 0);
+		}
+
+		const Render_Options& options() const { return options_; }
+		size_t thread_count() const { return pool_.size(); }
+		Thread_Pool& pool() { return pool_; }
+
+		// Tiles covering a width x height image, in scanline order
+		std::vector<Tile> tiles(size_t width, size_t height) const { return tiles(width, height, options_.tile_size); }
+		static std::vector<Tile> tiles(size_t width, size_t height, size_t tile_size) {
+			assert(tile_size > 0);
+			std::vector<Tile> result;
+			for (size_t y = 0; y < height; y += tile_size)
+				for (size_t x = 0; x < width; x += tile_size)
+					result.push_back({ x, y, std::min(width, x + tile_size), std::min(height, y + tile_size) });
+			return result;
+		}
+
+		// The image must match the scene's viewport resolution
+		void render(const Scene& scene, Image& image) {
+			std::vector<Tile> all = tiles(image.x_resolution(), image.y_resolution());
+			render(scene, image, all);
+		}
+		// Renders only the given tiles
+		void render(const Scene& scene, Image& image, const std::vector<Tile>& tiles) {
+			submit(scene, scene.camera(), image, tiles, [](const Tile&) {});
+			pool_.wait();
+		}
+
+		// Renders into image and writes it to a PPM file meanwhile: tiles are rendered roughly in
+		// file order, and each finished band of tiles is encoded and written while the rest of
+		// the image is still rendering. False if the file could not be written.
+		bool render(const Scene& scene, Image& image, const std::string& file_name) {
+			std::vector<Tile> tiles = this->tiles(image.x_resolution(), image.y_resolution());
+			std::reverse(tiles.begin(), tiles.end());
+			PPM_Stream_Writer writer(image, file_name, options_.tile_size);
+			submit(scene, scene.camera(), image, tiles, [&writer](const Tile& tile) { writer.pixels_done(tile.y0, tile.pixel_count()); }, true);
+			pool_.wait();
+			return writer.close();
+		}
+
+		// Queues the tiles without waiting, seen through camera instead of the scene's; tile_done
+		// runs on the worker after each tile. Everything referenced must outlive the tasks.
+		// Every worker starts on a contiguous band of tiles, or with in_order on every
+		// thread_count-th tile, so the tiles finish about in the given order.
+		template <class Tile_Done>
+		void submit(const Scene& scene, const Camera& camera, Image& image, const std::vector<Tile>& tiles, Tile_Done tile_done,
+			bool in_order = false) {
+			size_t workers = pool_.size();
+			auto task = [&scene, &camera, &image, &tiles, tile_done, this](size_t i) {
+				return [&scene, &camera, &image, &tiles, tile_done, i, this]() {
+					render_tile(scene, camera, tiles[i], image, options_);
+					tile_done(tiles[i]);
+				};
+			};
+			// Queued back to front, as a worker takes its newest task first
+			for (size_t worker = 0; worker < workers; ++worker) {
+				if (in_order) {
+					for (size_t i = tiles.size(); i-- > 0;)
+						if (i % workers == worker)
+							pool_.submit(task(i), worker);
+				}
+				else {
+					size_t first = tiles.size() * worker / workers, end = tiles.size() * (worker + 1) / workers;
+					for (size_t i = end; i-- > first;)
+						pool_.submit(task(i), worker);
+				}
+			}
+		}
+
+		static void render_tile(const Scene& scene, const Tile& tile, Image& image, const Render_Options& options) {
+			render_tile(scene, scene.camera(), tile, image, options);
+		}
+		// Only the closest hit of each pixel becomes an Intersection
+		static void render_tile(const Scene& scene, const Camera& camera, const Tile& tile, Image& image, const Render_Options& options) {
+			const size_t packet_side = options.packet_side;
+			std::vector<Intersection> intersections;
+			std::vector<std::array<size_t, 2>> hit_pixels;
+			auto shade_pixel = [&](size_t x, size_t y, const Ray& ray, const Hit_Record& hit) {
+				if (!hit.is_hit()) {
+					image.pixel(x, y) = scene.background();
+				}
+				else if (options.batch_shading) {
+					intersections.push_back(hit.object->make_intersection(ray, hit));
+					hit_pixels.push_back({ x, y });
+				}
+				else {
+					image.pixel(x, y) = scene.shader().shade(scene, camera, hit.object->make_intersection(ray, hit));
+				}
+			};
+			if (packet_side > 0) {
+				Ray_Packet packet;
+				std::vector<Hit_Record> hits;
+				std::vector<std::array<size_t, 2>> pixels;
+				std::vector<std::array<size_t, 2>> block_order = packet_block_order(packet_side);
+				for (size_t block_y = tile.y0; block_y < tile.y1; block_y += packet_side) {
+					for (size_t block_x = tile.x0; block_x < tile.x1; block_x += packet_side) {
+						packet.clear();
+						pixels.clear();
+						for (const auto& offset : block_order) {
+							size_t x = block_x + offset[0], y = block_y + offset[1];
+							if (x >= tile.x1 || y >= tile.y1)
+								continue;
+							Vector2<real> uv = scene.viewport().uv(x, y);
+							packet.add(scene.projection().compute_ray(camera, uv[0], uv[1]));
+							pixels.push_back({ x, y });
+						}
+						scene.closest_hits(packet, RAY_EPSILON, hits);
+						for (size_t i = 0; i < pixels.size(); ++i)
+							shade_pixel(pixels[i][0], pixels[i][1], packet.ray(i), hits[i]);
+					}
+				}
+			}
+			else {
+				for (size_t y = tile.y0; y < tile.y1; ++y) {
+					for (size_t x = tile.x0; x < tile.x1; ++x) {
+						Vector2<real> uv = scene.viewport().uv(x, y);
+						Ray ray = scene.projection().compute_ray(camera, uv[0], uv[1]);
+						shade_pixel(x, y, ray, scene.closest_hit(ray, RAY_EPSILON, REAL_INFINITY));
+					}
+				}
+			}
+			if (intersections.empty())
+				return;
+			std::vector<HDR_rgb> colors;
+			shade_batch(scene, camera, intersections, colors);
+			for (size_t i = 0; i < colors.size(); ++i)
+				image.pixel(hit_pixels[i][0], hit_pixels[i][1]) = colors[i];
+		}
+
+		// colors[i] is the colour of intersections[i], shaded by one shade_batch() call on the
+		// intersections grouped by object
+		static void shade_batch(const Scene& scene, const Camera& camera, const std::vector<Intersection>& intersections, std::vector<HDR_rgb>& colors) {
+			std::vector<uint32_t> order(intersections.size());
+			for (uint32_t i = 0; i < order.size(); ++i)
+				order[i] = i;
+			std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+				return std::less<const Abstract_Object*>()(&intersections[a].object(), &intersections[b].object());
+			});
+			std::vector<Intersection> grouped;
+			grouped.reserve(order.size());
+			for (uint32_t i : order)
+				grouped.push_back(intersections[i]);
+			std::vector<HDR_rgb> grouped_colors(grouped.size());
+			scene.shader().shade_batch(scene, camera, grouped.data(), grouped.size(), grouped_colors.data());
+			colors.resize(grouped.size());
+			for (size_t i = 0; i < order.size(); ++i)
+				colors[order[i]] = grouped_colors[i];
+		}
+
+	private:
+		Render_Options options_;
+		Thread_Pool pool_;
+	};
+
+}
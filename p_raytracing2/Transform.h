@@ -0,0 +1,95 @@
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include "Matrix.h"
+#include "Vector.h"
+#include "Bounding_Box.h"
+#include "Misc.h"
+
+namespace RT {
+
+	// Affine transform as a Matrix4x4 acting on column vectors, with its inverse kept alongside.
+	// a * b applies b first, then a.
+	class Transform {
+	public:
+		Transform() : matrix_(Matrix4x4<real>().identity()), inverse_(matrix_) {}
+		Transform(const Transform&) = default;
+		Transform& operator=(const Transform&) = default;
+		explicit Transform(const Matrix4x4<real>& matrix) : matrix_(matrix), inverse_(matrix.inverse()) {
+			assert(matrix_[3][0] == 0.0 && matrix_[3][1] == 0.0 && matrix_[3][2] == 0.0 && matrix_[3][3] == 1.0);
+		}
+
+		static Transform translation(const Direction& offset) {
+			return Transform(Matrix4x4<real>({ 1, 0, 0, offset[0],  0, 1, 0, offset[1],  0, 0, 1, offset[2],  0, 0, 0, 1 }));
+		}
+		static Transform scaling(const Vector3<real>& factors) {
+			return Transform(Matrix4x4<real>({ factors[0], 0, 0, 0,  0, factors[1], 0, 0,  0, 0, factors[2], 0,  0, 0, 0, 1 }));
+		}
+		static Transform scaling(real factor) { return scaling(Vector3<real>(factor)); }
+		// Counterclockwise by angle radians around axis, looking against it
+		static Transform rotation(const Direction& axis, real angle) {
+			Direction u = axis.normalized();
+			real c = std::cos(angle), s = std::sin(angle), t = 1 - c;
+			return Transform(Matrix4x4<real>({
+				t * u[0] * u[0] + c,		t * u[0] * u[1] - s * u[2], t * u[0] * u[2] + s * u[1], 0,
+				t * u[0] * u[1] + s * u[2], t * u[1] * u[1] + c,		t * u[1] * u[2] - s * u[0], 0,
+				t * u[0] * u[2] - s * u[1], t * u[1] * u[2] + s * u[0], t * u[2] * u[2] + c,		0,
+				0, 0, 0, 1 }));
+		}
+
+		const Matrix4x4<real>& matrix() const { return matrix_; }
+		const Matrix4x4<real>& inverse_matrix() const { return inverse_; }
+		Transform inverse() const { return Transform(inverse_, matrix_); }
+
+		Transform operator*(const Transform& rhs) const { return Transform(matrix_ * rhs.matrix_, rhs.inverse_ * inverse_); }
+
+		Point point(const Point& p) const { return apply_point(matrix_, p); }
+		Direction direction(const Direction& d) const { return apply_direction(matrix_, d); }
+		// Normals transform by the inverse transpose, so they stay perpendicular to scaled surfaces
+		Direction normal(const Direction& n) const {
+			Direction result;
+			for (size_t i = 0; i < 3; ++i)
+				result[i] = inverse_[0][i] * n[0] + inverse_[1][i] * n[1] + inverse_[2][i] * n[2];
+			return result.normalized();
+		}
+		Point inverse_point(const Point& p) const { return apply_point(inverse_, p); }
+		Direction inverse_direction(const Direction& d) const { return apply_direction(inverse_, d); }
+
+		// Bounds of the transformed corners of box
+		Bounding_Box box(const Bounding_Box& box) const {
+			Bounding_Box result;
+			for (size_t corner = 0; corner < 8; ++corner) {
+				Point p({ (corner & 1) ? box.max()[0] : box.min()[0],
+						  (corner & 2) ? box.max()[1] : box.min()[1],
+						  (corner & 4) ? box.max()[2] : box.min()[2] });
+				result.expand(point(p));
+			}
+			return result;
+		}
+
+		friend std::ostream& operator<<(std::ostream& out, const Transform& transform) {
+			return out << transform.matrix_;
+		}
+
+	private:
+		Transform(const Matrix4x4<real>& matrix, const Matrix4x4<real>& inverse) : matrix_(matrix), inverse_(inverse) {}
+
+		static Point apply_point(const Matrix4x4<real>& m, const Point& p) {
+			Point result;
+			for (size_t i = 0; i < 3; ++i)
+				result[i] = m[i][0] * p[0] + m[i][1] * p[1] + m[i][2] * p[2] + m[i][3];
+			return result;
+		}
+		static Direction apply_direction(const Matrix4x4<real>& m, const Direction& d) {
+			Direction result;
+			for (size_t i = 0; i < 3; ++i)
+				result[i] = m[i][0] * d[0] + m[i][1] * d[1] + m[i][2] * d[2];
+			return result;
+		}
+
+		Matrix4x4<real> matrix_;
+		Matrix4x4<real> inverse_;
+	};
+
+}
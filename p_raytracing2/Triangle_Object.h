@@ -1,66 +1,90 @@
 #pragma once
 #include <optional>
+#include <cmath>
 #include "Abstract_Object.h"
-#include "Matrix.h"
 #include "Intersection.h"
 
 namespace RT {
 
-	class Triangle_Object : public Abstract_Object {
+	class Triangle_Object final : public Abstract_Object {
 	public:
 		Triangle_Object() = delete;
-		Triangle_Object(Point a, Point b, Point c, const HDR_rgb& color, double shininess = 0.1) : a_(a), b_(b), c_(c), Abstract_Object(color,shininess) {}
+		Triangle_Object(Point a, Point b, Point c, const HDR_rgb& color, real shininess = 0.1)
+			: a_(a), b_(b), c_(c), edge_ab_(b - a), edge_ac_(c - a), Abstract_Object(color,shininess) {
+			normal_ = edge_ab_.cross(edge_ac_).normalized();
+		}
 
 		const Point& a() const { return a_; }
 		const Point& b() const { return b_; }
 		const Point& c() const { return c_; }
+		const Direction& normal() const { return normal_; }
+		virtual Bounding_Box bounding_box() const {
+			Bounding_Box box(a_);
+			box.expand(b_);
+			box.expand(c_);
+			return box;
+		}
 
-		virtual std::optional<Intersection> intersect(const Ray& ray, double t_min, double t_max) const {
-			assert(t_min < t_max);
-			// Setup the matrix, based on the book.
-			Matrix3x3<double> mat;
-			mat[0][0] = a_[0] - b_[0];
-			mat[0][1] = a_[0] - c_[0];
-			mat[0][2] = ray.direction()[0];
-			mat[1][0] = a_[1] - b_[1];
-			mat[1][1] = a_[1] - c_[1];
-			mat[1][2] = ray.direction()[1];
-			mat[2][0] = a_[2] - b_[2];
-			mat[2][1] = a_[2] - c_[2];
-			mat[2][2] = ray.direction()[2];
-			// Setup the vector
-			Vector3<double> vec;
-			vec[0] = a_[0] - ray.origin()[0];
-			vec[1] = a_[1] - ray.origin()[1];
-			vec[2] = a_[2] - ray.origin()[2];
-			Vector3<double> byt = mat.solve(vec);
+		// Moller-Trumbore test against the precomputed edges. Only finds the distance t and the
+		// barycentric coordinates of the hit; make_intersection() builds the rest.
+		bool hit(const Ray& ray, real t_min, real t_max, real& t) const {
+			real beta, gamma;
+			return hit(ray, t_min, t_max, t, beta, gamma);
+		}
+		bool hit(const Ray& ray, real t_min, real t_max, real& t, real& beta, real& gamma) const {
+			Vector3<real> p = ray.direction().cross(edge_ac_);
+			real det = edge_ab_ * p;
+			if (det == 0.0)
+				return false;	// ray parallel to the triangle
+			real inv_det = 1.0 / det;
+			Vector3<real> s = ray.origin() - a_;
+			beta = (s * p) * inv_det;
+			if (beta < 0.0 || beta > 1.0)
+				return false;
+			Vector3<real> q = s.cross(edge_ab_);
+			gamma = (ray.direction() * q) * inv_det;
+			if (gamma < 0.0 || beta + gamma > 1.0)
+				return false;
+			t = (edge_ac_ * q) * inv_det;
+			return t_min <= t && t <= t_max;
+		}
 
-			// Ensure t, beta, and gamma are valid
-			if (byt[2] < t_min || byt[2] > t_max)
-				return std::nullopt;
-			if (byt[1] < 0 || byt[1] > 1)
-				return std::nullopt;
-			if (byt[0] < 0 || byt[0] > 1 - byt[1])
+		Intersection intersection(const Ray& ray, real t) const {
+			return Intersection(this, ray.point_along_ray(t), t, normal_);
+		}
+
+		virtual std::optional<Intersection> intersect(const Ray& ray, real t_min, real t_max) const {
+			assert(t_min < t_max);
+			real t;
+			if (!hit(ray, t_min, t_max, t))
 				return std::nullopt;
+			return intersection(ray, t);
+		}
+
+		virtual bool find_hit(const Ray& ray, real t_min, Hit_Record& record) const {
+			real t, beta, gamma;
+			if (!hit(ray, t_min, record.t, t, beta, gamma) || !(t < record.t))
+				return false;
+			record = Hit_Record(t);
+			record.object = this;
+			record.u = static_cast<float>(beta);
+			record.v = static_cast<float>(gamma);
+			return true;
+		}
+
+		virtual Intersection make_intersection(const Ray& ray, const Hit_Record& record) const {
+			return intersection(ray, record.t);
+		}
 
-			// Calculate intersection and return it
-			Vector3<double> point = ray.origin() + ray.direction()*byt[2];
-			// Math to find the correct normal
-			Vector3<double> normal;
-			Vector3<double> normal_candidate_0 = (c_ - a_).cross(b_ - a_).normalized();
-			Vector3<double> normal_candidate_1 = (b_ - a_).cross(c_ - a_).normalized();
-			auto semi_normal = -ray.direction();
-			double temp_0 = normal_candidate_0 * semi_normal;
-			double temp_1 = normal_candidate_1 * semi_normal;
-			if (abs(temp_0) < abs(temp_1))
-				normal = normal_candidate_0;
-			else
-				normal = normal_candidate_1;
-			return std::optional<Intersection>(Intersection(this, point, byt[2], normal));
+		virtual bool occluded(const Ray& ray, real t_min, real t_max) const {
+			real t;
+			return hit(ray, t_min, t_max, t) && t < t_max;
 		}
 
 	private:
 		Point a_, b_, c_;
+		Vector3<real> edge_ab_, edge_ac_;
+		Direction normal_;
 	};
 
 }
\ No newline at end of file
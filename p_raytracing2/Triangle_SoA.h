@@ -0,0 +1,254 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "SIMD.h"
+#include "Vector.h"
+#include "Ray.h"
+
+namespace RT {
+
+	// Triangles prepared for intersection, stored as structure of arrays in single precision:
+	// the first corner and the two edges leaving it. Consecutive triangles are consecutive
+	// floats, so a BVH leaf over a range of triangles is loaded straight into vector lanes.
+	class Triangle_SoA {
+	public:
+		static const uint32_t NO_HIT = std::numeric_limits<uint32_t>::max();
+		static const size_t PADDING = 8;	// zeroed floats after the last triangle, so full width loads stay in bounds
+
+		// A ray converted once per traversal instead of once per triangle
+		struct Ray_Data {
+			Ray_Data() = default;
+			explicit Ray_Data(const Ray& ray) {
+				for (size_t i = 0; i < 3; ++i) {
+					origin[i] = static_cast<float>(ray.origin()[i]);
+					direction[i] = static_cast<float>(ray.direction()[i]);
+				}
+			}
+			float origin[3];
+			float direction[3];
+		};
+
+		// The component arrays V0, E1 and E2 (x, y, z each) as the kernels read them. Other
+		// storage, like Quantized_Mesh, decodes into such lanes and calls the same kernels.
+		enum { V0 = 0, E1 = 3, E2 = 6, COMPONENTS = 9 };
+		using Lanes = std::array<const float*, COMPONENTS>;
+
+	public:
+		Triangle_SoA() = default;
+
+		// indices holds three vertex indices per triangle
+		void assign(const std::vector<Point>& vertices, const std::vector<uint32_t>& indices) {
+			size_t count = indices.size() / 3;
+			for (auto& component : data_)
+				component.assign(count + PADDING, 0.0f);
+			for (size_t i = 0; i < count; ++i) {
+				const Point& a = vertices[indices[3 * i]];
+				const Point& b = vertices[indices[3 * i + 1]];
+				const Point& c = vertices[indices[3 * i + 2]];
+				for (size_t axis = 0; axis < 3; ++axis) {
+					data_[V0 + axis][i] = static_cast<float>(a[axis]);
+					data_[E1 + axis][i] = static_cast<float>(b[axis] - a[axis]);
+					data_[E2 + axis][i] = static_cast<float>(c[axis] - a[axis]);
+				}
+			}
+			size_ = count;
+		}
+
+		size_t size() const { return size_; }
+		size_t memory_bytes() const { return data_.size() * (size_ + PADDING) * sizeof(float); }
+
+		// Moller-Trumbore over triangles [first, first + count). Returns the closest triangle
+		// hit within [t_min, t_max) and shrinks t_max to its distance, or NO_HIT.
+		uint32_t closest_hit(const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float& t_max) const {
+			return closest_hit(lanes(), ray, first, count, t_min, t_max);
+		}
+		static uint32_t closest_hit(const Lanes& data, const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float& t_max) {
+			return hit<false>(data, ray, first, count, t_min, t_max);
+		}
+
+		// Some triangle of the range hit within [t_min, t_max), not necessarily the closest, or
+		// NO_HIT. The kernels return from the first vector iteration with a hit.
+		uint32_t first_hit(const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float t_max) const {
+			return first_hit(lanes(), ray, first, count, t_min, t_max);
+		}
+		static uint32_t first_hit(const Lanes& data, const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float t_max) {
+			return hit<true>(data, ray, first, count, t_min, t_max);
+		}
+		bool any_hit(const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float t_max) const {
+			return first_hit(ray, first, count, t_min, t_max) != NO_HIT;
+		}
+
+		// Barycentric coordinates of the hit on triangle i, for a ray known to hit it
+		void barycentrics(const Ray_Data& ray, uint32_t i, float& beta, float& gamma) const {
+			barycentrics(lanes(), ray, i, beta, gamma);
+		}
+		static void barycentrics(const Lanes& data, const Ray_Data& ray, uint32_t i, float& beta, float& gamma) {
+			float e1[3] = { data[E1][i], data[E1 + 1][i], data[E1 + 2][i] };
+			float e2[3] = { data[E2][i], data[E2 + 1][i], data[E2 + 2][i] };
+			float p[3] = { ray.direction[1] * e2[2] - ray.direction[2] * e2[1],
+						   ray.direction[2] * e2[0] - ray.direction[0] * e2[2],
+						   ray.direction[0] * e2[1] - ray.direction[1] * e2[0] };
+			float inv_det = 1.0f / (e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2]);
+			float s[3] = { ray.origin[0] - data[V0][i], ray.origin[1] - data[V0 + 1][i], ray.origin[2] - data[V0 + 2][i] };
+			float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+			beta = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+			gamma = (ray.direction[0] * q[0] + ray.direction[1] * q[1] + ray.direction[2] * q[2]) * inv_det;
+		}
+
+		// FIRST returns the first hit found instead of the closest one
+		template <bool FIRST>
+		static uint32_t hit(const Lanes& data, const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float& t_max) {
+#if defined(RT_SSE)
+			switch (active_kernel()) {
+			case SIMD_Kernel::AVX2: return hit_avx2<FIRST>(data, ray, first, count, t_min, t_max);
+			case SIMD_Kernel::SSE:	return hit_sse<FIRST>(data, ray, first, count, t_min, t_max);
+			default: break;
+			}
+#endif
+			return hit_scalar<FIRST>(data, ray, first, count, t_min, t_max);
+		}
+
+		template <bool FIRST>
+		static uint32_t hit_scalar(const Lanes& data, const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float& t_max) {
+			uint32_t best = NO_HIT;
+			for (uint32_t i = first; i < first + count; ++i) {
+				float e1[3] = { data[E1][i], data[E1 + 1][i], data[E1 + 2][i] };
+				float e2[3] = { data[E2][i], data[E2 + 1][i], data[E2 + 2][i] };
+				float p[3] = { ray.direction[1] * e2[2] - ray.direction[2] * e2[1],
+							   ray.direction[2] * e2[0] - ray.direction[0] * e2[2],
+							   ray.direction[0] * e2[1] - ray.direction[1] * e2[0] };
+				float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+				if (det == 0.0f)
+					continue;
+				float inv_det = 1.0f / det;
+				float s[3] = { ray.origin[0] - data[V0][i], ray.origin[1] - data[V0 + 1][i], ray.origin[2] - data[V0 + 2][i] };
+				float beta = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+				if (beta < 0.0f || beta > 1.0f)
+					continue;
+				float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+				float gamma = (ray.direction[0] * q[0] + ray.direction[1] * q[1] + ray.direction[2] * q[2]) * inv_det;
+				if (gamma < 0.0f || beta + gamma > 1.0f)
+					continue;
+				float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+				if (t_min <= t && t < t_max) {
+					if (FIRST)
+						return i;
+					t_max = t;
+					best = i;
+				}
+			}
+			return best;
+		}
+
+#if defined(RT_SSE)
+		template <bool FIRST>
+		static uint32_t hit_sse(const Lanes& data, const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float& t_max) {
+			const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+			const __m128 lane_index = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+			const __m128 o[3] = { _mm_set1_ps(ray.origin[0]), _mm_set1_ps(ray.origin[1]), _mm_set1_ps(ray.origin[2]) };
+			const __m128 d[3] = { _mm_set1_ps(ray.direction[0]), _mm_set1_ps(ray.direction[1]), _mm_set1_ps(ray.direction[2]) };
+			const __m128 t_lower = _mm_set1_ps(t_min);
+			uint32_t best = NO_HIT;
+			for (uint32_t base = first; base < first + count; base += 4) {
+				__m128 e1[3], e2[3], s[3];
+				for (size_t axis = 0; axis < 3; ++axis) {
+					e1[axis] = _mm_loadu_ps(&data[E1 + axis][base]);
+					e2[axis] = _mm_loadu_ps(&data[E2 + axis][base]);
+					s[axis] = _mm_sub_ps(o[axis], _mm_loadu_ps(&data[V0 + axis][base]));
+				}
+				__m128 p[3] = { _mm_sub_ps(_mm_mul_ps(d[1], e2[2]), _mm_mul_ps(d[2], e2[1])),
+								_mm_sub_ps(_mm_mul_ps(d[2], e2[0]), _mm_mul_ps(d[0], e2[2])),
+								_mm_sub_ps(_mm_mul_ps(d[0], e2[1]), _mm_mul_ps(d[1], e2[0])) };
+				__m128 det = dot_sse(e1, p);
+				__m128 inv_det = _mm_div_ps(one, det);
+				__m128 beta = _mm_mul_ps(dot_sse(s, p), inv_det);
+				__m128 q[3] = { _mm_sub_ps(_mm_mul_ps(s[1], e1[2]), _mm_mul_ps(s[2], e1[1])),
+								_mm_sub_ps(_mm_mul_ps(s[2], e1[0]), _mm_mul_ps(s[0], e1[2])),
+								_mm_sub_ps(_mm_mul_ps(s[0], e1[1]), _mm_mul_ps(s[1], e1[0])) };
+				__m128 gamma = _mm_mul_ps(dot_sse(d, q), inv_det);
+				__m128 t = _mm_mul_ps(dot_sse(e2, q), inv_det);
+				__m128 valid = _mm_cmplt_ps(lane_index, _mm_set1_ps(static_cast<float>(first + count - base)));
+				valid = _mm_and_ps(valid, _mm_cmpneq_ps(det, zero));
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(beta, zero), _mm_cmple_ps(beta, one)));
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(gamma, zero), _mm_cmple_ps(_mm_add_ps(beta, gamma), one)));
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, t_lower), _mm_cmplt_ps(t, _mm_set1_ps(t_max))));
+				if (_mm_movemask_ps(valid) == 0)
+					continue;
+				if (FIRST)
+					return base + lowest_bit(static_cast<unsigned>(_mm_movemask_ps(valid)));
+				// Closest valid lane: horizontal minimum, then the first lane holding it
+				__m128 candidates = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, infinity));
+				__m128 minimum = _mm_min_ps(candidates, _mm_shuffle_ps(candidates, candidates, _MM_SHUFFLE(2, 3, 0, 1)));
+				minimum = _mm_min_ps(minimum, _mm_shuffle_ps(minimum, minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+				int lanes = _mm_movemask_ps(_mm_and_ps(valid, _mm_cmpeq_ps(candidates, minimum)));
+				t_max = _mm_cvtss_f32(minimum);
+				best = base + lowest_bit(static_cast<unsigned>(lanes));
+			}
+			return best;
+		}
+
+		template <bool FIRST>
+		RT_TARGET_AVX2
+		static uint32_t hit_avx2(const Lanes& data, const Ray_Data& ray, uint32_t first, uint32_t count, float t_min, float& t_max) {
+			const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), infinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+			const __m256 lane_index = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+			const __m256 o[3] = { _mm256_set1_ps(ray.origin[0]), _mm256_set1_ps(ray.origin[1]), _mm256_set1_ps(ray.origin[2]) };
+			const __m256 d[3] = { _mm256_set1_ps(ray.direction[0]), _mm256_set1_ps(ray.direction[1]), _mm256_set1_ps(ray.direction[2]) };
+			const __m256 t_lower = _mm256_set1_ps(t_min);
+			uint32_t best = NO_HIT;
+			for (uint32_t base = first; base < first + count; base += 8) {
+				__m256 e1[3], e2[3], s[3];
+				for (size_t axis = 0; axis < 3; ++axis) {
+					e1[axis] = _mm256_loadu_ps(&data[E1 + axis][base]);
+					e2[axis] = _mm256_loadu_ps(&data[E2 + axis][base]);
+					s[axis] = _mm256_sub_ps(o[axis], _mm256_loadu_ps(&data[V0 + axis][base]));
+				}
+				__m256 p[3] = { _mm256_sub_ps(_mm256_mul_ps(d[1], e2[2]), _mm256_mul_ps(d[2], e2[1])),
+								_mm256_sub_ps(_mm256_mul_ps(d[2], e2[0]), _mm256_mul_ps(d[0], e2[2])),
+								_mm256_sub_ps(_mm256_mul_ps(d[0], e2[1]), _mm256_mul_ps(d[1], e2[0])) };
+				__m256 det = dot_avx2(e1, p);
+				__m256 inv_det = _mm256_div_ps(one, det);
+				__m256 beta = _mm256_mul_ps(dot_avx2(s, p), inv_det);
+				__m256 q[3] = { _mm256_sub_ps(_mm256_mul_ps(s[1], e1[2]), _mm256_mul_ps(s[2], e1[1])),
+								_mm256_sub_ps(_mm256_mul_ps(s[2], e1[0]), _mm256_mul_ps(s[0], e1[2])),
+								_mm256_sub_ps(_mm256_mul_ps(s[0], e1[1]), _mm256_mul_ps(s[1], e1[0])) };
+				__m256 gamma = _mm256_mul_ps(dot_avx2(d, q), inv_det);
+				__m256 t = _mm256_mul_ps(dot_avx2(e2, q), inv_det);
+				__m256 valid = _mm256_cmp_ps(lane_index, _mm256_set1_ps(static_cast<float>(first + count - base)), _CMP_LT_OQ);
+				valid = _mm256_and_ps(valid, _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(beta, zero, _CMP_GE_OQ), _mm256_cmp_ps(beta, one, _CMP_LE_OQ)));
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(gamma, zero, _CMP_GE_OQ),
+					_mm256_cmp_ps(_mm256_add_ps(beta, gamma), one, _CMP_LE_OQ)));
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, t_lower, _CMP_GE_OQ),
+					_mm256_cmp_ps(t, _mm256_set1_ps(t_max), _CMP_LT_OQ)));
+				if (_mm256_movemask_ps(valid) == 0)
+					continue;
+				if (FIRST)
+					return base + lowest_bit(static_cast<unsigned>(_mm256_movemask_ps(valid)));
+				__m256 candidates = _mm256_blendv_ps(infinity, t, valid);
+				__m256 minimum = _mm256_min_ps(candidates, _mm256_permute_ps(candidates, _MM_SHUFFLE(2, 3, 0, 1)));
+				minimum = _mm256_min_ps(minimum, _mm256_permute_ps(minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+				minimum = _mm256_min_ps(minimum, _mm256_permute2f128_ps(minimum, minimum, 0x01));
+				int lanes = _mm256_movemask_ps(_mm256_and_ps(valid, _mm256_cmp_ps(candidates, minimum, _CMP_EQ_OQ)));
+				t_max = _mm256_cvtss_f32(minimum);
+				best = base + lowest_bit(static_cast<unsigned>(lanes));
+			}
+			return best;
+		}
+#endif
+
+	private:
+		Lanes lanes() const {
+			Lanes result;
+			for (size_t i = 0; i < COMPONENTS; ++i)
+				result[i] = data_[i].data();
+			return result;
+		}
+
+		std::array<std::vector<float>, COMPONENTS> data_;
+		size_t size_ = 0;
+	};
+
+}
\ No newline at end of file
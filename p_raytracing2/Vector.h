@@ -151,7 +151,7 @@ namespace RT {
 	template <typename scalar_type> using Vector2 = Vector<scalar_type, 2>;
 	template <typename scalar_type> using Vector3 = Vector<scalar_type, 3>;
 	template <typename scalar_type> using Vector4 = Vector<scalar_type, 4>;
-	using Point = Vector3<double>;
-	using Direction = Vector3<double>;
+	using Point = Vector3<real>;
+	using Direction = Vector3<real>;
 
 }
@@ -8,7 +8,7 @@ namespace RT {
 		Viewport() = delete;
 		Viewport(const Viewport& viewport) = default;
 		Viewport& operator=(const Viewport& viewport) = default;
-		Viewport(size_t x_res, size_t y_res, double left, double right, double bottom, double top) 
+		Viewport(size_t x_res, size_t y_res, real left, real right, real bottom, real top) 
 			: x_resolution_(x_res), y_resolution_(y_res), 
 			left_(left), right_(right), bottom_(bottom), top_(top) {
 			assert(x_resolution_ > 0);
@@ -23,18 +23,18 @@ namespace RT {
 
 		size_t x_resolution() const { return x_resolution_; }
 		size_t y_resolution() const { return y_resolution_; }
-		double left()   const { return left_; }
-		double right()  const { return right_; }
-		double bottom() const { return bottom_; }
-		double top()	const { return top_; }
+		real left()   const { return left_; }
+		real right()  const { return right_; }
+		real bottom() const { return bottom_; }
+		real top()	const { return top_; }
 
 		// Converts a coordinate pixel, to (u,v)
 			// u : left to right
 			// v : bottom to top
-		Vector2<double> uv(size_t x, size_t y) const {
-			double u = left_ + (right_ - left_)*(x + 0.5)/x_resolution_;
-			double v = bottom_ + (top_ - bottom_)*(y + 0.5)/y_resolution_;
-			return Vector2<double>({ u,v });
+		Vector2<real> uv(size_t x, size_t y) const {
+			real u = left_ + (right_ - left_)*(x + 0.5)/x_resolution_;
+			real v = bottom_ + (top_ - bottom_)*(y + 0.5)/y_resolution_;
+			return Vector2<real>({ u,v });
 		}
 
 		friend std::ostream& operator<<(std::ostream& out, const Viewport& viewport) {
@@ -46,7 +46,7 @@ namespace RT {
 
 	private:
 		size_t x_resolution_, y_resolution_;
-		double left_, right_, bottom_, top_;
+		real left_, right_, bottom_, top_;
 	};
 
 }
\ No newline at end of file
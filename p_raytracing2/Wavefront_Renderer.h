@@ -0,0 +1,359 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "Scene.h"
+#include "Image.h"
+#include "Ray.h"
+#include "Ray_Packet.h"
+#include "Hit_Record.h"
+#include "Intersection.h"
+#include "Abstract_Shader.h"
+#include "SIMD.h"
+#include "Thread_Pool.h"
+#include "Tile_Renderer.h"
+
+namespace RT {
+
+	// Rays waiting for a wavefront stage, as structure of arrays. Directions are unit length, and
+	// ray() rebuilds a queued ray without normalizing it again, so it is bit for bit the Ray the
+	// direct path would trace.
+	struct Ray_Queue {
+		std::array<std::vector<real>, 3> origin;
+		std::array<std::vector<real>, 3> direction;
+		std::vector<uint32_t> pixel;		// index into the wave's colours
+
+		size_t size() const { return pixel.size(); }
+		void clear() {
+			for (size_t axis = 0; axis < 3; ++axis) {
+				origin[axis].clear();
+				direction[axis].clear();
+			}
+			pixel.clear();
+		}
+		void push(const Point& from, const Direction& along, uint32_t index) {
+			for (size_t axis = 0; axis < 3; ++axis) {
+				origin[axis].push_back(from[axis]);
+				direction[axis].push_back(along[axis]);
+			}
+			pixel.push_back(index);
+		}
+		void push(const Ray& ray, uint32_t index) { push(ray.origin(), ray.direction(), index); }
+		Point ray_origin(size_t i) const { return Point({ origin[0][i], origin[1][i], origin[2][i] }); }
+		Direction ray_direction(size_t i) const { return Direction({ direction[0][i], direction[1][i], direction[2][i] }); }
+		Ray ray(size_t i) const { return Ray::with_unit_direction(ray_origin(i), ray_direction(i)); }
+	};
+
+	// Shadow rays run from the hit point to the light and carry the term their light adds when it
+	// is visible. They are queued towards the light unnormalized; normalize() then turns the whole
+	// queue into unit directions and distances in one pass over the lanes.
+	struct Shadow_Queue : Ray_Queue {
+		std::vector<real> distance;		// to the light, set by normalize()
+		std::vector<const Light*> light;
+		std::array<std::vector<real>, 3> diffuse;
+		std::vector<real> specular;
+
+		void clear() {
+			Ray_Queue::clear();
+			distance.clear();
+			light.clear();
+			for (auto& component : diffuse)
+				component.clear();
+			specular.clear();
+		}
+		void push(const Point& from, const Deferred_Light& deferred, uint32_t index) {
+			Ray_Queue::push(from, deferred.light->location() - from, index);
+			light.push_back(deferred.light);
+			for (size_t channel = 0; channel < 3; ++channel)
+				diffuse[channel].push_back(deferred.term.diffuse[channel]);
+			specular.push_back(deferred.term.specular);
+		}
+		// The arithmetic of Direction::magnitude() and normalized(), lane by lane
+		void normalize() {
+			distance.resize(size());
+			for (size_t i = 0; i < size(); ++i)
+				distance[i] = direction[0][i] * direction[0][i] + direction[1][i] * direction[1][i] + direction[2][i] * direction[2][i];
+			sqrt_lanes(distance.data(), distance.size());
+			for (auto& component : direction)
+				for (size_t i = 0; i < size(); ++i)
+					component[i] /= distance[i];
+		}
+		Light_Term term(size_t i) const { return Light_Term{ { diffuse[0][i], diffuse[1][i], diffuse[2][i] }, specular[i] }; }
+	};
+
+	struct Wavefront_Statistics {
+		size_t primary_rays = 0;
+		size_t shadow_rays = 0;
+		double generate = 0.0, extend = 0.0, shade = 0.0, shadow = 0.0;	// seconds summed over the workers
+		// Consecutive shadow rays in one octant and one coarse origin cell, in queue and in traced
+		// order; counted only while shadow rays are sorted
+		size_t shadow_pairs = 0, coherent_queued = 0, coherent_traced = 0;
+
+		Wavefront_Statistics& operator+=(const Wavefront_Statistics& rhs) {
+			primary_rays += rhs.primary_rays;
+			shadow_rays += rhs.shadow_rays;
+			generate += rhs.generate;
+			extend += rhs.extend;
+			shade += rhs.shade;
+			shadow += rhs.shadow;
+			shadow_pairs += rhs.shadow_pairs;
+			coherent_queued += rhs.coherent_queued;
+			coherent_traced += rhs.coherent_traced;
+			return *this;
+		}
+		friend std::ostream& operator<<(std::ostream& out, const Wavefront_Statistics& statistics) {
+			out << statistics.primary_rays << " primary rays, " << statistics.shadow_rays << " shadow rays, generate="
+				<< statistics.generate << "s extend=" << statistics.extend << "s shade=" << statistics.shade
+				<< "s shadow=" << statistics.shadow << "s";
+			if (statistics.shadow_pairs > 0)
+				out << ", coherent shadow ray pairs " << 100.0 * statistics.coherent_queued / statistics.shadow_pairs << "% queued, "
+					<< 100.0 * statistics.coherent_traced / statistics.shadow_pairs << "% sorted";
+			return out;
+		}
+	};
+
+	// Renders in waves of one tile each, with the per pixel work split into stages that each run
+	// over the whole wave: generate the primary rays, extend them to their closest hits, shade
+	// the hits, trace the shadow rays the shading queued. Every stage is one loop over the wave,
+	// so its code and data stay hot. A tile of 64 x 64 pixels makes waves of 4096 primary rays.
+	// The queues are structures of arrays: the shadow rays are normalized in one vectorised pass
+	// and their sort keys read straight from the lanes, while traversal still takes one Ray, or
+	// one Ray_Packet, at a time, rebuilt from the lanes without normalizing it again.
+	//
+	// Shadows are deferred for shaders that implement Abstract_Shader::shade_deferred(); any other
+	// shader gets the wave's hits in one shade_batch call. Each pixel's lights are added in the
+	// order the shader gave them, so the image equals that of a Tile_Renderer. With a packet_side
+	// the primary rays are generated block by block and extended as packets.
+	//
+	// Shadow rays leave scattered hit points, so in pixel order they hit the BVH at random. With
+	// sort_shadow_rays each wave's shadow rays are traced ordered by direction octant, then by
+	// the Morton code of their origin within the scene bounds, so consecutive rays walk the same
+	// nodes; their results are still added in queue order.
+	class Wavefront_Renderer {
+	public:
+		Wavefront_Renderer() : Wavefront_Renderer(Render_Options()) {}
+		Wavefront_Renderer(const Wavefront_Renderer&) = delete;
+		Wavefront_Renderer& operator=(const Wavefront_Renderer&) = delete;
+		explicit Wavefront_Renderer(const Render_Options& options) : options_(options), pool_(options.thread_count), waves_(pool_.size()) {
+			assert(options_.tile_size > 0);
+		}
+
+		const Render_Options& options() const { return options_; }
+		size_t thread_count() const { return pool_.size(); }
+		bool sort_shadow_rays() const { return sort_shadow_rays_; }
+		void sort_shadow_rays(bool sort) { sort_shadow_rays_ = sort; }
+		// Of the last render
+		Wavefront_Statistics statistics() const {
+			Wavefront_Statistics result;
+			for (const Wave& wave : waves_)
+				result += wave.statistics;
+			return result;
+		}
+
+		void render(const Scene& scene, Image& image) {
+			std::vector<Tile> tiles = Tile_Renderer::tiles(image.x_resolution(), image.y_resolution(), options_.tile_size);
+			for (Wave& wave : waves_)
+				wave.statistics = Wavefront_Statistics();
+			size_t workers = pool_.size();
+			for (size_t worker = 0; worker < workers; ++worker) {
+				size_t first = tiles.size() * worker / workers, end = tiles.size() * (worker + 1) / workers;
+				for (size_t i = end; i-- > first;)
+					pool_.submit([&, i]() { render_wave(scene, tiles[i], image, waves_[Thread_Pool::current_worker()]); }, worker);
+			}
+			pool_.wait();
+		}
+
+	private:
+		using clock = std::chrono::steady_clock;
+
+		// Queues of one worker, reused from wave to wave
+		struct Wave {
+			Ray_Queue primary;
+			std::vector<size_t> packet_ends;	// primary rays [packet_ends[i - 1], packet_ends[i]) form packet i
+			Ray_Packet packet;
+			std::vector<Hit_Record> hits;
+			std::vector<Hit_Record> packet_hits;
+			Shadow_Queue shadows;
+			std::vector<HDR_rgb> colors;
+			std::vector<Deferred_Light> deferred;	// of the hit being shaded
+			std::vector<Intersection> batch;		// hits for shaders without deferred lighting
+			std::vector<uint32_t> batch_pixels;
+			std::vector<HDR_rgb> batch_colors;
+			std::vector<uint64_t> shadow_order;	// sort key above, queue index below
+			std::vector<uint8_t> visible;
+			Wavefront_Statistics statistics;
+		};
+
+		// Interleaves the bits of a point's cell in a 1024^3 grid over bounds
+		static uint32_t morton_code(const Point& p, const Bounding_Box& bounds) {
+			uint32_t code = 0;
+			for (size_t axis = 0; axis < 3; ++axis) {
+				real extent = bounds.max()[axis] - bounds.min()[axis];
+				real position = (extent > 0) ? (p[axis] - bounds.min()[axis]) / extent : real(0);
+				uint32_t cell = static_cast<uint32_t>(std::min<real>(1023, std::max<real>(0, position * 1024)));
+				for (uint32_t bit = 0; bit < 10; ++bit)
+					code |= ((cell >> bit) & 1u) << (3 * bit + axis);
+			}
+			return code;
+		}
+		static uint32_t octant(const Direction& d) {
+			return (d[0] < 0 ? 1u : 0u) | (d[1] < 0 ? 2u : 0u) | (d[2] < 0 ? 4u : 0u);
+		}
+		// Same octant and the same cell of a 32^3 grid
+		static bool coherent(uint64_t a, uint64_t b) { return (a >> 46) == (b >> 46); }
+
+		static double seconds(clock::time_point& start) {
+			clock::time_point now = clock::now();
+			double elapsed = std::chrono::duration<double>(now - start).count();
+			start = now;
+			return elapsed;
+		}
+
+		void render_wave(const Scene& scene, const Tile& tile, Image& image, Wave& wave) const {
+			clock::time_point start = clock::now();
+			generate(scene, tile, options_.packet_side, wave);
+			wave.statistics.generate += seconds(start);
+			extend(scene, wave);
+			wave.statistics.extend += seconds(start);
+			shade(scene, wave);
+			wave.statistics.shade += seconds(start);
+			shadow(scene, wave, sort_shadow_rays_);
+			wave.statistics.shadow += seconds(start);
+			wave.statistics.primary_rays += wave.primary.size();
+			wave.statistics.shadow_rays += wave.shadows.size();
+			size_t width = tile.x1 - tile.x0;
+			for (size_t i = 0; i < wave.colors.size(); ++i)
+				image.pixel(tile.x0 + i % width, tile.y0 + i / width) = wave.colors[i];
+		}
+
+		static void generate(const Scene& scene, const Tile& tile, size_t packet_side, Wave& wave) {
+			wave.primary.clear();
+			wave.packet_ends.clear();
+			size_t width = tile.x1 - tile.x0;
+			auto push = [&](size_t x, size_t y) {
+				Vector2<real> uv = scene.viewport().uv(x, y);
+				Ray ray = scene.projection().compute_ray(scene.camera(), uv[0], uv[1]);
+				wave.primary.push(ray, static_cast<uint32_t>((y - tile.y0) * width + (x - tile.x0)));
+			};
+			if (packet_side == 0) {
+				for (size_t y = tile.y0; y < tile.y1; ++y)
+					for (size_t x = tile.x0; x < tile.x1; ++x)
+						push(x, y);
+				return;
+			}
+			std::vector<std::array<size_t, 2>> block_order = packet_block_order(packet_side);
+			for (size_t block_y = tile.y0; block_y < tile.y1; block_y += packet_side) {
+				for (size_t block_x = tile.x0; block_x < tile.x1; block_x += packet_side) {
+					for (const auto& offset : block_order)
+						if (block_x + offset[0] < tile.x1 && block_y + offset[1] < tile.y1)
+							push(block_x + offset[0], block_y + offset[1]);
+					wave.packet_ends.push_back(wave.primary.size());
+				}
+			}
+		}
+
+		static void extend(const Scene& scene, Wave& wave) {
+			wave.hits.resize(wave.primary.size());
+			if (wave.packet_ends.empty()) {
+				for (size_t i = 0; i < wave.primary.size(); ++i)
+					wave.hits[i] = scene.closest_hit(wave.primary.ray(i), RAY_EPSILON, REAL_INFINITY);
+				return;
+			}
+			size_t first = 0;
+			for (size_t end : wave.packet_ends) {
+				wave.packet.clear();
+				for (size_t i = first; i < end; ++i)
+					wave.packet.add(wave.primary.ray(i));
+				scene.closest_hits(wave.packet, RAY_EPSILON, wave.packet_hits);
+				std::copy(wave.packet_hits.begin(), wave.packet_hits.end(), wave.hits.begin() + first);
+				first = end;
+			}
+		}
+
+		static void shade(const Scene& scene, Wave& wave) {
+			const Abstract_Shader& shader = scene.shader();
+			wave.shadows.clear();
+			wave.batch.clear();
+			wave.batch_pixels.clear();
+			wave.colors.resize(wave.primary.size());
+			for (size_t i = 0; i < wave.primary.size(); ++i) {
+				const Hit_Record& hit = wave.hits[i];
+				HDR_rgb& color = wave.colors[wave.primary.pixel[i]];
+				if (!hit.is_hit()) {
+					color = scene.background();
+					continue;
+				}
+				Intersection intersection = hit.object->make_intersection(wave.primary.ray(i), hit);
+				wave.deferred.clear();
+				if (!shader.shade_deferred(scene, scene.camera(), intersection, color, wave.deferred)) {
+					wave.batch.push_back(intersection);
+					wave.batch_pixels.push_back(wave.primary.pixel[i]);
+					continue;
+				}
+				for (const Deferred_Light& deferred : wave.deferred)
+					wave.shadows.push(intersection.location(), deferred, wave.primary.pixel[i]);
+			}
+			wave.shadows.normalize();
+			if (wave.batch.empty())
+				return;
+			Tile_Renderer::shade_batch(scene, scene.camera(), wave.batch, wave.batch_colors);
+			for (size_t i = 0; i < wave.batch.size(); ++i)
+				wave.colors[wave.batch_pixels[i]] = wave.batch_colors[i];
+		}
+
+		static void shadow(const Scene& scene, Wave& wave, bool sort) {
+			const Shadow_Queue& shadows = wave.shadows;
+			if (shadows.size() == 0)
+				return;
+			const Abstract_Shader& shader = scene.shader();
+			auto visible = [&](size_t i) {
+				Point origin = shadows.ray_origin(i);
+				return shader.light_visible(scene, *shadows.light[i], shadows.ray(i), ray_epsilon(origin), shadows.distance[i]);
+			};
+			auto add = [&](size_t i) {
+				Abstract_Shader::add_clamped(wave.colors[shadows.pixel[i]], shadows.term(i));
+			};
+			if (!sort) {
+				for (size_t i = 0; i < shadows.size(); ++i)
+					if (visible(i))
+						add(i);
+				return;
+			}
+			// 3 octant bits and 30 Morton bits above a 31 bit queue index
+			assert(shadows.size() < (uint64_t(1) << 31));
+			Bounding_Box bounds = scene.bvh().bounding_box();
+			wave.shadow_order.resize(shadows.size());
+			for (size_t i = 0; i < shadows.size(); ++i) {
+				uint64_t key = (uint64_t(octant(shadows.ray_direction(i))) << 30) | morton_code(shadows.ray_origin(i), bounds);
+				wave.shadow_order[i] = (key << 31) | i;
+				if (i > 0 && coherent(wave.shadow_order[i - 1], wave.shadow_order[i]))
+					++wave.statistics.coherent_queued;
+			}
+			std::sort(wave.shadow_order.begin(), wave.shadow_order.end());
+			wave.visible.resize(shadows.size());
+			for (size_t i = 0; i < shadows.size(); ++i) {
+				uint64_t entry = wave.shadow_order[i];
+				size_t index = static_cast<size_t>(entry & ((uint64_t(1) << 31) - 1));
+				wave.visible[index] = visible(index);
+				if (i > 0 && coherent(wave.shadow_order[i - 1], entry))
+					++wave.statistics.coherent_traced;
+			}
+			if (shadows.size() > 0)
+				wave.statistics.shadow_pairs += shadows.size() - 1;
+			// Queue order keeps each pixel's lights in scene order
+			for (size_t i = 0; i < shadows.size(); ++i)
+				if (wave.visible[i])
+					add(i);
+		}
+
+		Render_Options options_;
+		Thread_Pool pool_;
+		std::vector<Wave> waves_;		// one per worker
+		bool sort_shadow_rays_ = false;
+	};
+
+}
@@ -0,0 +1,255 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "SIMD.h"
+#include "Bounding_Box.h"
+#include "Ray.h"
+
+namespace RT {
+
+	// Leaf callbacks of closest hit traversals return nothing. Any hit traversals return a bool
+	// instead, true when the leaf blocks the ray, and the traversal stops right there.
+	template <typename leaf_function>
+	bool visit_leaf(leaf_function& leaf, uint32_t first, uint32_t count, real& t_max) {
+		if constexpr (std::is_void_v<decltype(leaf(first, count, t_max))>) {
+			leaf(first, count, t_max);
+			return false;
+		}
+		else {
+			return leaf(first, count, t_max);
+		}
+	}
+
+	// Node of a WIDTH-ary BVH. The child boxes are stored as structure of arrays in
+	// single precision, so one ray is tested against all of them with a few vector
+	// instructions. Unused lanes hold an inverted box that no ray can hit.
+	template <size_t WIDTH>
+	struct alignas(32) Wide_Node {
+		enum { MIN_X = 0, MAX_X = 1, MIN_Y = 2, MAX_Y = 3, MIN_Z = 4, MAX_Z = 5 };
+		std::array<std::array<float, WIDTH>, 6> bounds;
+		std::array<uint32_t, WIDTH> child;	// leaf: first primitive index, interior: wide node index
+		std::array<uint32_t, WIDTH> count;	// number of primitives in a leaf, 0 for interior nodes
+	};
+
+	// Collapsed form of a binary BVH, see BVH::layout(). Only the node array differs from
+	// the binary tree: leaves still refer to ranges of the binary tree's primitive_indices().
+	template <size_t WIDTH>
+	class Wide_BVH {
+	public:
+		static_assert(WIDTH == 4 || WIDTH == 8, "Wide_BVH supports 4 and 8 wide nodes");
+		using node_type = Wide_Node<WIDTH>;
+		using node_storage_type = std::vector<node_type>;
+		static const size_t STACK_SIZE = 1024;
+
+	public:
+		Wide_BVH() = default;
+
+		// binary_node_type is BVH::Node, whose first child directly follows it
+		template <typename binary_node_type>
+		void build(const std::vector<binary_node_type>& binary_nodes) {
+			nodes_.clear();
+			if (binary_nodes.empty())
+				return;
+			nodes_.reserve(binary_nodes.size() / (WIDTH / 2) + 1);
+			if (binary_nodes[0].is_leaf()) {
+				nodes_.push_back(empty_node());
+				set_lane(nodes_[0], 0, binary_nodes[0], binary_nodes[0].offset);
+			}
+			else {
+				collapse(binary_nodes, 0);
+			}
+		}
+
+		void clear() { nodes_.clear(); }
+		bool is_empty() const { return nodes_.empty(); }
+		const node_storage_type& nodes() const { return nodes_; }
+
+		// Same contract as BVH::traverse_leaves
+		template <typename leaf_function>
+		void traverse(const Ray& ray, real t_min, real& t_max, leaf_function leaf) const {
+			if (nodes_.empty())
+				return;
+			Lane_Ray lane_ray(ray);
+			struct Entry { uint32_t node; float t_near; };
+			std::array<Entry, STACK_SIZE> stack;
+			size_t stack_size = 0;
+			stack[stack_size++] = Entry{ 0, static_cast<float>(t_min) };
+			while (stack_size > 0) {
+				Entry entry = stack[--stack_size];
+				if (entry.t_near > t_max)
+					continue;
+				const node_type& node = nodes_[entry.node];
+				alignas(32) std::array<float, WIDTH> t_near;
+				unsigned mask = intersect_lanes(node, lane_ray, static_cast<float>(t_min), far_limit(t_max), t_near.data());
+
+				// Leaves are tested right away, interior children are pushed farthest first
+				std::array<Entry, WIDTH> children;
+				size_t child_count = 0;
+				for (size_t lane = 0; mask != 0; ++lane, mask >>= 1) {
+					if ((mask & 1) == 0)
+						continue;
+					if (node.count[lane] > 0) {
+						if (visit_leaf(leaf, node.child[lane], node.count[lane], t_max))
+							return;
+					}
+					else {
+						children[child_count++] = Entry{ node.child[lane], t_near[lane] };
+					}
+				}
+				// At most WIDTH entries, insertion sort by decreasing t_near
+				for (size_t i = 1; i < child_count; ++i) {
+					Entry child = children[i];
+					size_t j = i;
+					for (; j > 0 && children[j - 1].t_near < child.t_near; --j)
+						children[j] = children[j - 1];
+					children[j] = child;
+				}
+				for (size_t i = 0; i < child_count; ++i)
+					stack[stack_size++] = children[i];
+			}
+		}
+
+	private:
+		struct Lane_Ray {
+			explicit Lane_Ray(const Ray& ray) {
+				for (size_t i = 0; i < 3; ++i) {
+					origin[i] = static_cast<float>(ray.origin()[i]);
+					inv_direction[i] = static_cast<float>(1.0 / ray.direction()[i]);
+					bool negative = inv_direction[i] < 0.0f;
+					near_plane[i] = 2 * i + (negative ? 1 : 0);
+					far_plane[i] = 2 * i + (negative ? 0 : 1);
+				}
+			}
+			std::array<float, 3> origin, inv_direction;
+			std::array<size_t, 3> near_plane, far_plane;
+		};
+
+		// Widen the far distance a little so single precision rounding never culls a box the
+		// primitive test would still hit in full precision
+		static float far_limit(real t_max) {
+			if (std::isinf(t_max))
+				return std::numeric_limits<float>::infinity();
+			return static_cast<float>(t_max) * 1.0000004f;
+		}
+
+		// Returns a bit per lane whose box the ray enters within [t_min, t_max]
+		static unsigned intersect_lanes(const node_type& node, const Lane_Ray& ray, float t_min, float t_max, float* t_near) {
+#if defined(RT_AVX)
+			if constexpr (WIDTH == 8) {
+				__m256 near_t = _mm256_set1_ps(t_min), far_t = _mm256_set1_ps(t_max);
+				for (size_t i = 0; i < 3; ++i) {
+					__m256 origin = _mm256_set1_ps(ray.origin[i]);
+					__m256 inv = _mm256_set1_ps(ray.inv_direction[i]);
+					__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[ray.near_plane[i]].data()), origin), inv);
+					__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[ray.far_plane[i]].data()), origin), inv);
+					near_t = _mm256_max_ps(near_t, t0);
+					far_t = _mm256_min_ps(far_t, t1);
+				}
+				_mm256_store_ps(t_near, near_t);
+				return static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(near_t, far_t, _CMP_LE_OQ)));
+			}
+#endif
+#if defined(RT_SSE)
+			unsigned mask = 0;
+			for (size_t half = 0; half < WIDTH; half += 4) {
+				__m128 near_t = _mm_set1_ps(t_min), far_t = _mm_set1_ps(t_max);
+				for (size_t i = 0; i < 3; ++i) {
+					__m128 origin = _mm_set1_ps(ray.origin[i]);
+					__m128 inv = _mm_set1_ps(ray.inv_direction[i]);
+					__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.near_plane[i]].data() + half), origin), inv);
+					__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.far_plane[i]].data() + half), origin), inv);
+					near_t = _mm_max_ps(near_t, t0);
+					far_t = _mm_min_ps(far_t, t1);
+				}
+				_mm_store_ps(t_near + half, near_t);
+				mask |= static_cast<unsigned>(_mm_movemask_ps(_mm_cmple_ps(near_t, far_t))) << half;
+			}
+			return mask;
+#else
+			unsigned mask = 0;
+			for (size_t lane = 0; lane < WIDTH; ++lane) {
+				float near_t = t_min, far_t = t_max;
+				for (size_t i = 0; i < 3; ++i) {
+					near_t = std::max(near_t, (node.bounds[ray.near_plane[i]][lane] - ray.origin[i]) * ray.inv_direction[i]);
+					far_t = std::min(far_t, (node.bounds[ray.far_plane[i]][lane] - ray.origin[i]) * ray.inv_direction[i]);
+				}
+				t_near[lane] = near_t;
+				if (near_t <= far_t)
+					mask |= 1u << lane;
+			}
+			return mask;
+#endif
+		}
+
+		static node_type empty_node() {
+			node_type node;
+			for (size_t lane = 0; lane < WIDTH; ++lane) {
+				for (size_t axis = 0; axis < 3; ++axis) {
+					node.bounds[2 * axis][lane] = std::numeric_limits<float>::infinity();
+					node.bounds[2 * axis + 1][lane] = -std::numeric_limits<float>::infinity();
+				}
+				node.child[lane] = 0;
+				node.count[lane] = 0;
+			}
+			return node;
+		}
+
+		// Rounds the box outwards, so the float box always contains it
+		template <typename binary_node_type>
+		static void set_lane(node_type& node, size_t lane, const binary_node_type& binary_node, uint32_t child) {
+			const Bounding_Box& box = binary_node.box;
+			for (size_t axis = 0; axis < 3; ++axis) {
+				float lower = static_cast<float>(box.min()[axis]);
+				float upper = static_cast<float>(box.max()[axis]);
+				node.bounds[2 * axis][lane] = std::nextafter(lower, -std::numeric_limits<float>::infinity());
+				node.bounds[2 * axis + 1][lane] = std::nextafter(upper, std::numeric_limits<float>::infinity());
+			}
+			node.child[lane] = child;
+			node.count[lane] = binary_node.count;
+		}
+
+		// Pulls up the grandchildren with the largest surface area until the node is full
+		template <typename binary_node_type>
+		uint32_t collapse(const std::vector<binary_node_type>& binary_nodes, uint32_t binary_index) {
+			const binary_node_type& root = binary_nodes[binary_index];
+			std::array<uint32_t, WIDTH> children;
+			size_t child_count = 0;
+			children[child_count++] = binary_index + 1;
+			children[child_count++] = root.offset;
+			while (child_count < WIDTH) {
+				size_t best = WIDTH;
+				double best_area = -1.0;
+				for (size_t i = 0; i < child_count; ++i) {
+					const binary_node_type& candidate = binary_nodes[children[i]];
+					if (!candidate.is_leaf() && candidate.box.surface_area() > best_area) {
+						best = i;
+						best_area = candidate.box.surface_area();
+					}
+				}
+				if (best == WIDTH)
+					break;
+				uint32_t opened = children[best];
+				children[best] = opened + 1;
+				children[child_count++] = binary_nodes[opened].offset;
+			}
+
+			uint32_t index = static_cast<uint32_t>(nodes_.size());
+			nodes_.push_back(empty_node());
+			for (size_t lane = 0; lane < child_count; ++lane) {
+				const binary_node_type& child = binary_nodes[children[lane]];
+				uint32_t target = child.is_leaf() ? child.offset : collapse(binary_nodes, children[lane]);
+				set_lane(nodes_[index], lane, child, target);
+			}
+			return index;
+		}
+
+		node_storage_type nodes_;
+	};
+
+}
\ No newline at end of file
@@ -1,6 +1,11 @@
 #include <iostream>
 #include <fstream>
 #include <optional>
+#include <chrono>
+#include <string>
+#include <random>
+#include <memory>
+#include <vector>
 #include "RT.h"
 //#define ORTHO_PROJ
 
@@ -22,16 +27,147 @@ Light light1(Point({ -50, 400, -200 }), HDR_rgb(1.0, 1.0, 1.0), 20);
 Sphere_Object sphere0(Point({ -0.7, 0.0, -2.0 }), 0.5, HDR_rgb(1.0, 0.0, 0.0), 20);
 Sphere_Object sphere1(Point({  0.7, 0.0, -2.0 }), 0.8, HDR_rgb(0.0, 1.0, 0.0), 20);
 
-Mesh mesh("slong.obj", HDR_rgb(0.8, 0.9, 0.4), 8);
 HDR_rgb background(0.0, 0.0, 0.0);
 Scene scene(&camera, &viewport, &projection, &shader, background);
 
-int main() {
+// Usage: p_raytracing2 [--layout binary|bvh4|bvh8] [--kernel scalar|sse|avx2] [--packet 0|2|4|8] [--particles count] [--instances count] [--quantize 0|16|21] [--threads count] [--tile size] [--processes count] [--frames count] [--path file] [--mesh file]... [--wavefront 0|1] [--sort-shadows 0|1] [--lights count] [--light-falloff 0|1] [--light-threshold value] [--light-samples count] [--occluder-cache 0|1] [--batch-shading 0|1]
+int main(int argc, char* argv[]) {
+	BVH_Build_Options bvh_options;
+	Render_Options render_options;
+	size_t process_count = 0;	// renders in this many worker processes instead of threads
+	size_t frame_count = 0;		// renders an animation of this many frames along a camera path instead
+	std::string path_file;		// camera keys for the animation, an orbit around the scene without one
+	bool wavefront = false;		// renders in stages over queues of rays instead of pixel by pixel
+	bool sort_shadows = false;	// the wavefront renderer traces shadow rays sorted by direction and origin
+	size_t particle_count = 0;	// random spheres around the mesh, as one Sphere_Set
+	size_t light_count = 0;		// extra weak point lights scattered over and around the mesh
+	size_t instance_count = 0;	// extra copies of the mesh on a grid behind it, sharing its geometry
+	size_t quantize_bits = 0;	// traces a Quantized_Mesh copy of the mesh instead, 0 keeps full precision
+	std::vector<Mesh_Source> mesh_sources = { { "slong.obj", HDR_rgb(0.8, 0.9, 0.4), 8 } };
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string option(argv[i]), value(argv[i + 1]);
+		if (option == "--layout")
+			bvh_options.layout = (value == "bvh4") ? BVH_Layout::WIDE_4 : (value == "bvh8") ? BVH_Layout::WIDE_8 : BVH_Layout::BINARY;
+		else if (option == "--kernel") {
+			SIMD_Kernel kernel = (value == "scalar") ? SIMD_Kernel::SCALAR : (value == "sse") ? SIMD_Kernel::SSE : SIMD_Kernel::AVX2;
+			active_kernel(kernel);
+		}
+		else if (option == "--packet")
+			render_options.packet_side = std::min<size_t>(std::stoul(value), 8);
+		else if (option == "--threads")
+			render_options.thread_count = std::stoul(value);
+		else if (option == "--tile")
+			render_options.tile_size = std::max<size_t>(std::stoul(value), 1);
+		else if (option == "--processes")
+			process_count = std::stoul(value);
+		else if (option == "--frames")
+			frame_count = std::stoul(value);
+		else if (option == "--path")
+			path_file = value;
+		else if (option == "--wavefront")
+			wavefront = (value != "0");
+		else if (option == "--sort-shadows")
+			sort_shadows = (value != "0");
+		else if (option == "--lights")
+			light_count = std::stoul(value);
+		else if (option == "--light-falloff")
+			shader.light_falloff(value != "0");
+		else if (option == "--light-threshold")
+			shader.light_threshold(static_cast<real>(std::stod(value)));
+		else if (option == "--light-samples")
+			shader.light_samples(std::stoul(value));
+		else if (option == "--batch-shading")
+			render_options.batch_shading = (value != "0");
+		else if (option == "--occluder-cache")
+			shader.occluder_cache(value != "0");
+		else if (option == "--particles")
+			particle_count = std::stoul(value);
+		else if (option == "--instances")
+			instance_count = std::stoul(value);
+		else if (option == "--quantize")
+			quantize_bits = std::stoul(value);
+		else if (option == "--mesh")
+			mesh_sources.push_back({ value, HDR_rgb(0.7, 0.7, 0.7), 8 });
+	}
+
+	auto load_start = std::chrono::steady_clock::now();
+	std::unique_ptr<Quantized_Mesh> quantized;
+	if (quantize_bits > 0) {
+		// The first mesh is built straight from its OBJ, its full precision Mesh never exists
+		const Mesh_Source& source = mesh_sources.front();
+		quantized = std::make_unique<Quantized_Mesh>(source.filename, source.color, source.shininess,
+			(quantize_bits > 16) ? Vertex_Quantization::BITS_21 : Vertex_Quantization::BITS_16);
+		mesh_sources.erase(mesh_sources.begin());
+	}
+	std::vector<std::unique_ptr<Mesh>> meshes = load_meshes(mesh_sources);
+	std::cout << "Load: " << meshes.size() + (quantized ? 1 : 0) << " meshes in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count() << "s" << std::endl;
+	Mesh* mesh = quantized ? nullptr : meshes[0].get();
+
 	//scene.add_object(&sphere0);
 	//scene.add_object(&sphere1);
-	scene.add_object(&mesh);
+	for (auto& loaded : meshes)
+		loaded->bvh_layout(bvh_options.layout);
+	for (auto& loaded : meshes)
+		if (loaded.get() != mesh)
+			scene.add_object(loaded.get());
+	if (quantized)
+		quantized->bvh_layout(bvh_options.layout);
+	Abstract_Object& geometry = quantized ? static_cast<Abstract_Object&>(*quantized) : *mesh;
+	scene.add_object(&geometry);
+	std::vector<Instance> instances;
+	if (instance_count > 0) {
+		Bounding_Box bounds = geometry.bounding_box();
+		Direction extent = bounds.extent();
+		real spacing = 1.5 * std::max({ extent[0], extent[1], extent[2] });
+		size_t columns = static_cast<size_t>(std::ceil(std::sqrt(real(instance_count + 1))));
+		Transform to_origin = Transform::translation(-bounds.centroid());
+		instances.reserve(instance_count);
+		for (size_t i = 1; i <= instance_count; ++i) {
+			Direction offset({ (i % columns) * spacing, 0.0, -real(i / columns) * spacing });
+			Transform placement = Transform::translation(bounds.centroid() + offset)
+				* Transform::rotation(Direction({ 0.0, 1.0, 0.0 }), 0.7 * i) * to_origin;
+			instances.emplace_back(geometry, placement);
+		}
+		for (Instance& instance : instances)
+			scene.add_object(&instance);
+	}
+	std::unique_ptr<Sphere_Set> particles;
+	if (particle_count > 0) {
+		Bounding_Box bounds = geometry.bounding_box();
+		real radius = (bounds.max() - bounds.min()).magnitude() / (20 * std::cbrt(real(particle_count)));
+		std::mt19937 generator(1);
+		std::vector<real> spheres;
+		spheres.reserve(4 * particle_count);
+		for (size_t i = 0; i < particle_count; ++i) {
+			for (size_t axis = 0; axis < 3; ++axis)
+				spheres.push_back(std::uniform_real_distribution<real>(bounds.min()[axis], bounds.max()[axis])(generator));
+			spheres.push_back(radius);
+		}
+		BVH_Build_Options particle_options = Sphere_Set::default_build_options();
+		particle_options.layout = bvh_options.layout;
+		particles = std::make_unique<Sphere_Set>(spheres.data(), particle_count, HDR_rgb(0.3, 0.5, 0.9), 20, particle_options);
+		scene.add_object(particles.get());
+	}
 	//scene.add_light(&light);
 	scene.add_light(&light1);
+	std::vector<Light> lights;
+	if (light_count > 0) {
+		Bounding_Box bounds = geometry.bounding_box();
+		Direction extent = bounds.extent();
+		std::mt19937 generator(2);
+		// With falloff, together about as bright over the mesh as one unattenuated light
+		real intensity_scale = extent.magnitude_squared() / real(light_count);
+		lights.reserve(light_count);
+		for (size_t i = 0; i < light_count; ++i) {
+			Point location;
+			for (size_t axis = 0; axis < 3; ++axis)
+				location[axis] = std::uniform_real_distribution<real>(bounds.min()[axis] - extent[axis], bounds.max()[axis] + extent[axis])(generator);
+			lights.emplace_back(location, HDR_rgb(1.0, 1.0, 1.0), std::uniform_real_distribution<real>(0.1, 2.0)(generator) * intensity_scale);
+		}
+		for (Light& light : lights)
+			scene.add_light(&light);
+	}
+	scene.build_bvh(bvh_options);
 
 	Image image(x_res, y_res);
 
@@ -39,20 +175,74 @@ int main() {
 	std::cout << "Viewport: " << viewport << std::endl;
 	std::cout << "Projection: " << projection << std::endl;
 	std::cout << "Background Color: " << background << std::endl;
+	if (mesh) {
+		std::cout << "Mesh BVH: " << mesh->bvh().statistics() << " layout=" << bvh_options.layout
+			<< (mesh->loaded_from_cache() ? " (cached)" : "") << std::endl;
+		std::cout << "Mesh: " << mesh->size() << " triangles, " << mesh->vertices().size() << " vertices, "
+			<< mesh->memory_bytes() / 1024 << " KiB, " << active_kernel() << " kernel" << std::endl;
+	}
+	if (quantized)
+		std::cout << "Quantized mesh: " << quantized->size() << " triangles, " << quantized->quantization() << ", "
+			<< quantized->memory_bytes() / 1024 << " KiB, max error " << quantized->max_error() << std::endl;
+	if (!instances.empty())
+		std::cout << "Instances: " << instances.size() << " copies of the mesh, " << instances.size() * sizeof(Instance) / 1024 << " KiB" << std::endl;
+	if (!lights.empty())
+		std::cout << "Lights: " << scene.lights().size() << (shader.light_falloff() ? ", falloff" : "") << ", threshold " << shader.light_threshold() << ", "
+			<< shader.light_samples() << " samples per point" << std::endl;
+	if (particles)
+		std::cout << "Particles: " << particles->size() << " spheres, " << particles->memory_bytes() / 1024 << " KiB, "
+			<< particles->bvh().statistics() << std::endl;
 
-	for (size_t y = 0; y < image.y_resolution(); ++y) {
-		for (size_t x = 0; x < image.x_resolution(); ++x) {
-			Vector2<double> uv = scene.viewport().uv(x, y);
-			Ray ray = scene.projection().compute_ray(camera, uv[0], uv[1]);
-			std::optional<Intersection> intersect = scene.intersect(ray, 0.01, DOUBLE_INFINITY);
-			if (intersect == std::nullopt) {
-				image.pixel(x, y) = background;
-			}
-			else {
-				image.pixel(x, y) = scene.shader().shade(scene,camera,*intersect);
-			}
+	auto start = std::chrono::steady_clock::now();
+	if (process_count > 0) {
+		Distributed_Options distributed_options;
+		distributed_options.process_count = process_count;
+		Distributed_Renderer renderer(render_options, distributed_options);
+		std::cout << "Renderer: " << renderer.process_count() << " processes, " << render_options.tile_size << " pixel tiles" << std::endl;
+		renderer.render(scene, image);
+		if (renderer.reissued_tiles() > 0)
+			std::cout << "Reissued tiles: " << renderer.reissued_tiles() << ", lost workers: " << renderer.lost_workers() << std::endl;
+	}
+	else if (frame_count > 0) {
+		Camera_Path path;
+		if (path_file.empty() || !path.load(path_file)) {
+			if (!path_file.empty())
+				std::cout << "Camera path " << path_file << " not readable, orbiting instead" << std::endl;
+			real size = scene.bvh().bounding_box().extent().magnitude();
+			path = Camera_Path::orbit(scene.bvh().bounding_box(), size, 0.4 * size);
 		}
+		Tile_Renderer renderer(render_options);
+		Animation_Renderer animation(renderer);
+		std::cout << "Animation: " << frame_count << " frames, " << renderer.thread_count() << " threads, "
+			<< animation.options().frames_in_flight << " frames in flight" << std::endl;
+		animation.render(scene, path.frames(frame_count));
+		std::cout << "Render: " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
+		if (shader.occluder_cache())
+			std::cout << "Occluder cache: " << Occluder_Cache::statistics() << std::endl;
+		return 0;
+	}
+	else if (wavefront) {
+		Wavefront_Renderer renderer(render_options);
+		renderer.sort_shadow_rays(sort_shadows);
+		std::cout << "Wavefront renderer: " << renderer.thread_count() << " threads, " << render_options.tile_size << " pixel tiles" << std::endl;
+		renderer.render(scene, image);
+		std::cout << "Wavefront: " << renderer.statistics() << std::endl;
+		if (shader.occluder_cache())
+			std::cout << "Occluder cache: " << Occluder_Cache::statistics() << std::endl;
+	}
+	else {
+		Tile_Renderer renderer(render_options);
+		std::cout << "Renderer: " << renderer.thread_count() << " threads, " << render_options.tile_size << " pixel tiles" << std::endl;
+		// The image is written while it renders
+		bool written = renderer.render(scene, image, "image.ppm");
+		std::cout << "Render and write: " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
+		if (!written)
+			std::cout << "image.ppm could not be written" << std::endl;
+		if (shader.occluder_cache())
+			std::cout << "Occluder cache: " << Occluder_Cache::statistics() << std::endl;
+		return 0;
 	}
+	std::cout << "Render: " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
 
 	ppm_writer(image, "image.ppm");
 